@@ -123,6 +123,11 @@ void FAST_FUNC data_extract_all(archive_handle_t *archive_handle)
 			flags,
 			file_header->mode
 			);
+#if ENABLE_FEATURE_TAR_SPARSE
+		if (file_header->tar__sparse)
+			data_copy_sparse(archive_handle, dst_fd, 0);
+		else
+#endif
 		bb_copyfd_exact_size(archive_handle->src_fd, dst_fd, file_header->size);
 		close(dst_fd);
 #ifdef ARCHIVE_REPLACE_VIA_RENAME
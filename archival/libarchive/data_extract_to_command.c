@@ -109,6 +109,11 @@ void FAST_FUNC data_extract_to_command(archive_handle_t *archive_handle)
 		close(p[0]);
 		/* Our caller is expected to do signal(SIGPIPE, SIG_IGN)
 		 * so that we don't die if child don't read all the input: */
+#if ENABLE_FEATURE_TAR_SPARSE
+		if (file_header->tar__sparse)
+			data_copy_sparse(archive_handle, p[1], 1);
+		else
+#endif
 		bb_copyfd_exact_size(archive_handle->src_fd, p[1], -file_header->size);
 		close(p[1]);
 
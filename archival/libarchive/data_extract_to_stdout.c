@@ -8,6 +8,12 @@
 
 void FAST_FUNC data_extract_to_stdout(archive_handle_t *archive_handle)
 {
+#if ENABLE_FEATURE_TAR_SPARSE
+	if (archive_handle->file_header->tar__sparse) {
+		data_copy_sparse(archive_handle, STDOUT_FILENO, 0);
+		return;
+	}
+#endif
 	bb_copyfd_exact_size(archive_handle->src_fd,
 			STDOUT_FILENO,
 			archive_handle->file_header->size);
@@ -158,6 +158,112 @@ static void process_pax_hdr(archive_handle_t *archive_handle, unsigned sz, int g
 	free(buf);
 }
 
+#if ENABLE_FEATURE_TAR_SPARSE
+static void add_sparse_entries(tar_sparse_t **sp, char (*ent)[2][12], int n)
+{
+	tar_sparse_t *s;
+	int i;
+
+	/* Used entries come first */
+	for (i = 0; i < n && ent[i][0][0]; i++)
+		continue;
+	n = i;
+	s = *sp = xrealloc(*sp, sizeof(*s) + ((*sp)->count + n) * sizeof(s->map[0]));
+	/* getOctal trashes the byte after the field: go backwards */
+	while (--i >= 0) {
+		s->map[s->count + i].numbytes = GET_OCTAL(ent[i][1]);
+		s->map[s->count + i].offset = GET_OCTAL(ent[i][0]);
+	}
+	s->count += n;
+}
+
+/* Read sparse map of GNU 'S' header and its extension blocks */
+static void read_sparse_map(archive_handle_t *archive_handle, struct tar_header_t *tar)
+{
+	tar_sparse_header_t *sh = (void*)tar->prefix;
+	tar_sparse_t *s;
+	char isextended;
+	unsigned i;
+	off_t end, stored;
+
+	s = xzalloc(sizeof(*s));
+	isextended = sh->isextended; /* before GET_OCTALs trash it */
+	s->realsize = GET_OCTAL(sh->realsize);
+	add_sparse_entries(&s, sh->sp, 4);
+	while (isextended) {
+		tar_sparse_ext_t ext;
+
+		xread(archive_handle->src_fd, &ext, sizeof(ext));
+		archive_handle->offset += sizeof(ext);
+		isextended = ext.isextended;
+		add_sparse_entries(&s, ext.sp, 21);
+	}
+	/* Regions must be in order, inside the file,
+	 * and add up to the size of stored data */
+	end = stored = 0;
+	for (i = 0; i < s->count; i++) {
+		if (s->map[i].offset < end
+		 || s->map[i].numbytes < 0
+		 || s->map[i].offset + s->map[i].numbytes > s->realsize
+		) {
+			break;
+		}
+		end = s->map[i].offset + s->map[i].numbytes;
+		stored += s->map[i].numbytes;
+	}
+	if (i != s->count || stored != archive_handle->file_header->size)
+		bb_error_msg_and_die("corrupted sparse map");
+	archive_handle->file_header->tar__sparse = s;
+}
+
+void FAST_FUNC data_copy_sparse(archive_handle_t *archive_handle, int dst_fd, int ignore_write_err)
+{
+	tar_sparse_t *s = archive_handle->file_header->tar__sparse;
+	struct stat st;
+	char *zeros = NULL;
+	smallint can_seek;
+	off_t pos;
+	unsigned i;
+
+	/* Make holes in regular files, write zeros to anything else */
+	can_seek = (fstat(dst_fd, &st) == 0 && S_ISREG(st.st_mode));
+	pos = 0;
+	for (i = 0; i <= s->count; i++) {
+		off_t gap, n;
+
+		/* After the last region: hole up to realsize, if any */
+		n = (i < s->count) ? s->map[i].numbytes : 0;
+		gap = ((i < s->count) ? s->map[i].offset : s->realsize) - pos;
+		pos += gap + n;
+		if (gap && can_seek) {
+			xlseek(dst_fd, gap, SEEK_CUR);
+		} else if (gap && dst_fd >= 0) {
+			if (!zeros)
+				zeros = xzalloc(4 * 1024);
+			while (gap) {
+				ssize_t w = gap > 4 * 1024 ? 4 * 1024 : gap;
+				if (full_write(dst_fd, zeros, w) != w) {
+					if (!ignore_write_err)
+						bb_perror_msg_and_die(bb_msg_write_error);
+					dst_fd = -1; /* but we still have to consume input */
+					break;
+				}
+				gap -= w;
+			}
+		}
+		if (n)
+			bb_copyfd_exact_size(archive_handle->src_fd, dst_fd, ignore_write_err ? -n : n);
+	}
+	free(zeros);
+	if (can_seek) {
+		/* A hole at the end needs the file to be made longer */
+		off_t cur = xlseek(dst_fd, 0, SEEK_CUR);
+		if (fstat(dst_fd, &st) == 0 && cur > st.st_size && ftruncate(dst_fd, cur) != 0)
+			bb_perror_msg_and_die(bb_msg_write_error);
+	}
+}
+#endif
+
 char FAST_FUNC get_header_tar(archive_handle_t *archive_handle)
 {
 	file_header_t *file_header = archive_handle->file_header;
@@ -289,6 +395,7 @@ char FAST_FUNC get_header_tar(archive_handle_t *archive_handle)
 	/* 0 is reserved for high perf file, treat as normal file */
 	if (!tar.typeflag) tar.typeflag = '0';
 	parse_names = (tar.typeflag >= '0' && tar.typeflag <= '7');
+	IF_FEATURE_TAR_SPARSE(if (tar.typeflag == 'S') parse_names = 1;)
 
 	/* getOctal trashes subsequent field, therefore we call it
 	 * on fields in reverse order */
@@ -317,6 +424,15 @@ char FAST_FUNC get_header_tar(archive_handle_t *archive_handle)
 	/* Set bits 0-11 of the files mode */
 	file_header->mode = 07777 & GET_OCTAL(tar.mode);
 
+#if ENABLE_FEATURE_TAR_SPARSE
+	file_header->tar__sparse = NULL;
+	if (tar.typeflag == 'S') {
+		read_sparse_map(archive_handle, &tar);
+		/* In GNU headers, prefix[] is not a prefix */
+		tar.prefix[0] = '\0';
+	}
+#endif
+
 	file_header->name = NULL;
 	if (!p_longname && parse_names) {
 		/* we trash mode[0] here, it's ok */
@@ -378,6 +494,11 @@ char FAST_FUNC get_header_tar(archive_handle_t *archive_handle)
 	case '6':
 		file_header->mode |= S_IFIFO;
 		goto size0;
+#if ENABLE_FEATURE_TAR_SPARSE
+	case 'S':
+		file_header->mode |= S_IFREG;
+		break;
+#endif
 #if ENABLE_FEATURE_TAR_GNU_EXTENSIONS
 	case 'L':
 		/* free: paranoia: tar with several consecutive longnames */
@@ -401,7 +522,9 @@ char FAST_FUNC get_header_tar(archive_handle_t *archive_handle)
 	case 'D':	/* GNU dump dir */
 	case 'M':	/* Continuation of multi volume archive */
 	case 'N':	/* Old GNU for names > 100 characters */
+# if !ENABLE_FEATURE_TAR_SPARSE
 	case 'S':	/* Sparse file */
+# endif
 	case 'V':	/* Volume header */
 #endif
 	case 'g':	/* pax global header */
@@ -465,6 +588,7 @@ char FAST_FUNC get_header_tar(archive_handle_t *archive_handle)
 	archive_handle->offset += file_header->size;
 
 	free(file_header->link_target);
+	IF_FEATURE_TAR_SPARSE(free(file_header->tar__sparse);)
 	/* Do not free(file_header->name)!
 	 * It might be inserted in archive_handle->passed - see above */
 #if ENABLE_FEATURE_TAR_UNAME_GNAME
@@ -10,6 +10,7 @@ void FAST_FUNC header_verbose_list(const file_header_t *file_header)
 {
 	struct tm tm_time;
 	struct tm *ptm = &tm_time; //localtime(&file_header->mtime);
+	off_t size = file_header->size;
 
 #if ENABLE_FEATURE_TAR_UNAME_GNAME
 	char uid[sizeof(int)*3 + 2];
@@ -18,6 +19,11 @@ void FAST_FUNC header_verbose_list(const file_header_t *file_header)
 	char *group;
 
 	localtime_r(&file_header->mtime, ptm);
+#if ENABLE_FEATURE_TAR_SPARSE
+	/* Show size with holes, not how much is stored */
+	if (file_header->tar__sparse)
+		size = file_header->tar__sparse->realsize;
+#endif
 
 	user = file_header->tar__uname;
 	if (user == NULL) {
@@ -33,7 +39,7 @@ void FAST_FUNC header_verbose_list(const file_header_t *file_header)
 		bb_mode_string(file_header->mode),
 		user,
 		group,
-		file_header->size,
+		size,
 		1900 + ptm->tm_year,
 		1 + ptm->tm_mon,
 		ptm->tm_mday,
@@ -45,12 +51,16 @@ void FAST_FUNC header_verbose_list(const file_header_t *file_header)
 #else /* !FEATURE_TAR_UNAME_GNAME */
 
 	localtime_r(&file_header->mtime, ptm);
+#if ENABLE_FEATURE_TAR_SPARSE
+	if (file_header->tar__sparse)
+		size = file_header->tar__sparse->realsize;
+#endif
 
 	printf("%s %u/%u %9"OFF_FMT"u %4u-%02u-%02u %02u:%02u:%02u %s",
 		bb_mode_string(file_header->mode),
 		(unsigned)file_header->uid,
 		(unsigned)file_header->gid,
-		file_header->size,
+		size,
 		1900 + ptm->tm_year,
 		1 + ptm->tm_mon,
 		ptm->tm_mday,
@@ -100,6 +100,15 @@
 //config:	  With this option busybox supports GNU long filenames and
 //config:	  linknames.
 //config:
+//config:config FEATURE_TAR_SPARSE
+//config:	bool "Support for sparse files"
+//config:	default y
+//config:	depends on FEATURE_TAR_GNU_EXTENSIONS && TAR
+//config:	help
+//config:	  With -S, tar -c stores files with holes in GNU sparse format:
+//config:	  holes (found with SEEK_DATA/SEEK_HOLE) are neither read
+//config:	  nor stored. Such members are extracted with holes again.
+//config:
 //config:config FEATURE_TAR_LONG_OPTIONS
 //config:	bool "Enable long options"
 //config:	default y
@@ -192,6 +201,9 @@ typedef struct TarBallInfo {
 	const llist_t *excludeList;     /* List of files to not include */
 	HardLinkInfo *hlInfoHead;       /* Hard Link Tracking Information */
 	HardLinkInfo *hlInfo;           /* Hard Link Info for the current file */
+#if ENABLE_FEATURE_TAR_SPARSE
+	tar_sparse_t *sparse;           /* Data regions of the current file */
+#endif
 //TODO: save only st_dev + st_ino
 	struct stat tarFileStatBuf;     /* Stat info for the tarball, letting
 	                                 * us know the inode and device that the
@@ -212,6 +224,7 @@ enum {
 	CONTTYPE = '7',		/* reserved */
 	GNULONGLINK = 'K',	/* GNU long (>100 chars) link name */
 	GNULONGNAME = 'L',	/* GNU long (>100 chars) file name */
+	GNUSPARSE = 'S',	/* GNU sparse file */
 	EXTTYPE = 'x',		/* ext metadata for next file, store selinux_context */
 };
 
@@ -286,6 +299,94 @@ static void putOctal(char *cp, int len, off_t value)
 }
 #define PUT_OCTAL(a, b) putOctal((a), sizeof(a), (b))
 
+/* GNU tar uses "base-256 encoding" for very large numbers.
+ * Encoding is binary, with highest bit always set as a marker
+ * and sign in next-highest bit:
+ * 80 00 .. 00 - zero
+ * bf ff .. ff - largest positive number
+ * ff ff .. ff - minus 1
+ * c0 00 .. 00 - smallest negative number
+ */
+static void putBase256(char *cp, int len, uoff_t value)
+{
+	char *p8 = cp + len;
+	do {
+		*--p8 = (uint8_t)value;
+		value >>= 8;
+	} while (p8 != cp);
+	*p8 |= 0x80;
+}
+
+#if ENABLE_FEATURE_TAR_SPARSE
+static void putSparseNumber(char *cp, uoff_t value)
+{
+	if (sizeof(value) <= 4 || value <= (uoff_t)0777777777777LL)
+		putOctal(cp, 12, value);
+	else
+		putBase256(cp, 12, value);
+}
+
+/* Store up to n (offset, numbytes) pairs starting from sp->map[i].
+ * Returns index of the first pair which did not fit */
+static unsigned putSparseEntries(char (*ent)[2][12], unsigned n,
+		const tar_sparse_t *sp, unsigned i)
+{
+	unsigned j;
+
+	for (j = 0; j < n && i < sp->count; j++, i++) {
+		putSparseNumber(ent[j][0], sp->map[i].offset);
+		putSparseNumber(ent[j][1], sp->map[i].numbytes);
+	}
+	return i;
+}
+
+/* Find data regions of a file with holes.
+ * Returns NULL if we can't tell, then file is stored as usual */
+static tar_sparse_t *getSparseMap(int fd, off_t size)
+{
+	tar_sparse_t *sp = xzalloc(sizeof(*sp));
+	off_t pos = 0;
+
+	sp->realsize = size;
+	while (pos < size) {
+		off_t data, hole;
+
+		data = lseek(fd, pos, SEEK_DATA);
+		if (data < 0) {
+			if (errno == ENXIO) /* only a hole up to EOF is left */
+				break;
+			goto no_map;
+		}
+		if (data >= size)
+			break;
+		hole = lseek(fd, data, SEEK_HOLE);
+		if (hole < 0)
+			goto no_map;
+		/* If file grows meanwhile, we store only what header says */
+		if (hole > size)
+			hole = size;
+		sp = xrealloc(sp, sizeof(*sp) + sp->count * sizeof(sp->map[0]));
+		sp->map[sp->count].offset = data;
+		sp->map[sp->count].numbytes = hole - data;
+		sp->count++;
+		pos = hole;
+	}
+	/* Like GNU tar, end the map with an entry at EOF */
+	if (pos != size || sp->count == 0) {
+		sp = xrealloc(sp, sizeof(*sp) + sp->count * sizeof(sp->map[0]));
+		sp->map[sp->count].offset = size;
+		sp->map[sp->count].numbytes = 0;
+		sp->count++;
+	}
+	xlseek(fd, 0, SEEK_SET);
+	return sp;
+ no_map:
+	free(sp);
+	xlseek(fd, 0, SEEK_SET);
+	return NULL;
+}
+#endif
+
 static void chksum_and_xwrite(int fd, struct tar_header_t* hp)
 {
 	/* POSIX says that checksum is done on unsigned bytes
@@ -452,6 +553,15 @@ static int writeTarHeader(struct TarBallInfo *tbInfo,
 		/* header.size field is 12 bytes long */
 		/* Does octal-encoded size fit? */
 		uoff_t filesize = statbuf->st_size;
+#if ENABLE_FEATURE_TAR_SPARSE
+		unsigned i;
+		/* Only data regions are stored */
+		if (tbInfo->sparse) {
+			filesize = 0;
+			for (i = 0; i < tbInfo->sparse->count; i++)
+				filesize += tbInfo->sparse->map[i].numbytes;
+		}
+#endif
 		if (sizeof(filesize) <= 4
 		 || filesize <= (uoff_t)0777777777777LL
 		) {
@@ -465,26 +575,22 @@ static int writeTarHeader(struct TarBallInfo *tbInfo,
 		 && (filesize <= 0x3fffffffffffffffffffffffLL)
 #endif
 		) {
-			/* GNU tar uses "base-256 encoding" for very large numbers.
-			 * Encoding is binary, with highest bit always set as a marker
-			 * and sign in next-highest bit:
-			 * 80 00 .. 00 - zero
-			 * bf ff .. ff - largest positive number
-			 * ff ff .. ff - minus 1
-			 * c0 00 .. 00 - smallest negative number
-			 */
-			char *p8 = header.size + sizeof(header.size);
-			do {
-				*--p8 = (uint8_t)filesize;
-				filesize >>= 8;
-			} while (p8 != header.size);
-			*p8 |= 0x80;
+			putBase256(header.size, sizeof(header.size), filesize);
 		} else {
 			bb_error_msg_and_die("can't store file '%s' "
 				"of size %"FILESIZE_FMT"u, aborting",
 				fileName, statbuf->st_size);
 		}
 		header.typeflag = REGTYPE;
+#if ENABLE_FEATURE_TAR_SPARSE
+		if (tbInfo->sparse) {
+			tar_sparse_header_t *sh = (void*)header.prefix;
+			header.typeflag = GNUSPARSE;
+			putSparseNumber(sh->realsize, tbInfo->sparse->realsize);
+			i = putSparseEntries(sh->sp, 4, tbInfo->sparse, 0);
+			sh->isextended = (i < tbInfo->sparse->count);
+		}
+#endif
 	} else {
 		bb_error_msg("%s: unknown file type", fileName);
 		return FALSE;
@@ -513,6 +619,21 @@ static int writeTarHeader(struct TarBallInfo *tbInfo,
 	/* Now write the header out to disk */
 	chksum_and_xwrite(tbInfo->tarFd, &header);
 
+#if ENABLE_FEATURE_TAR_SPARSE
+	/* Sparse map entries which did not fit into the header */
+	if (tbInfo->sparse) {
+		unsigned i = 4;
+		while (i < tbInfo->sparse->count) {
+			tar_sparse_ext_t ext;
+
+			memset(&ext, 0, sizeof(ext));
+			i = putSparseEntries(ext.sp, 21, tbInfo->sparse, i);
+			ext.isextended = (i < tbInfo->sparse->count);
+			xwrite(tbInfo->tarFd, &ext, sizeof(ext));
+		}
+	}
+#endif
+
 	/* Now do the verbose thing (or not) */
 	if (tbInfo->verboseFlag) {
 		FILE *vbFd = stdout;
@@ -626,6 +747,15 @@ static int FAST_FUNC writeFileToTarball(const char *fileName, struct stat *statb
 			return FALSE;
 		}
 	}
+#if ENABLE_FEATURE_TAR_SPARSE
+	tbInfo->sparse = NULL;
+	if (inputFileFd >= 0 && (tbInfo->optFlags & ARCHIVE_STORE_SPARSE)
+	 /* Does it have holes? */
+	 && statbuf->st_blocks < statbuf->st_size / 512
+	) {
+		tbInfo->sparse = getSparseMap(inputFileFd, statbuf->st_size);
+	}
+#endif
 
 	/* Add an entry to the tarball */
 	if (writeTarHeader(tbInfo, header_name, fileName, statbuf) == FALSE) {
@@ -635,6 +765,22 @@ static int FAST_FUNC writeFileToTarball(const char *fileName, struct stat *statb
 	/* If it was a regular file, write out the body */
 	if (inputFileFd >= 0) {
 		size_t readSize;
+		off_t size = statbuf->st_size;
+#if ENABLE_FEATURE_TAR_SPARSE
+		if (tbInfo->sparse) {
+			unsigned i;
+			/* Write only data regions, skipping holes */
+			size = 0;
+			for (i = 0; i < tbInfo->sparse->count; i++) {
+				xlseek(inputFileFd, tbInfo->sparse->map[i].offset, SEEK_SET);
+				bb_copyfd_exact_size(inputFileFd, tbInfo->tarFd,
+						tbInfo->sparse->map[i].numbytes);
+				size += tbInfo->sparse->map[i].numbytes;
+			}
+			free(tbInfo->sparse);
+			tbInfo->sparse = NULL;
+		} else
+#endif
 		/* Write the file to the archive. */
 		/* We record size into header first, */
 		/* and then write out file. If file shrinks in between, */
@@ -655,7 +801,7 @@ static int FAST_FUNC writeFileToTarball(const char *fileName, struct stat *statb
 
 		/* Pad the file up to the tar block size */
 		/* (a few tricks here in the name of code size) */
-		readSize = (-(int)statbuf->st_size) & (TAR_BLOCK_SIZE-1);
+		readSize = (-(int)size) & (TAR_BLOCK_SIZE-1);
 		memset(block_buf, 0, readSize);
 		xwrite(tbInfo->tarFd, block_buf, readSize);
 	}
@@ -843,6 +989,7 @@ static llist_t *append_file_list_to_list(llist_t *list)
 //usage:	IF_FEATURE_SEAMLESS_LZMA("a")
 //usage:	IF_FEATURE_TAR_CREATE("h")
 //usage:	IF_FEATURE_TAR_NOPRESERVE_TIME("m")
+//usage:	IF_FEATURE_TAR_SPARSE("S")
 //usage:	IF_FEATURE_TAR_SELINUX("p")
 //usage:	"vO] "
 //usage:	IF_FEATURE_TAR_FROM("[-X FILE] [-T FILE] ")
@@ -882,6 +1029,9 @@ static llist_t *append_file_list_to_list(llist_t *list)
 //usage:	IF_FEATURE_TAR_NOPRESERVE_TIME(
 //usage:     "\n	m	Don't restore mtime"
 //usage:	)
+//usage:	IF_FEATURE_TAR_SPARSE(
+//usage:     "\n	S	Store holes in sparse files efficiently"
+//usage:	)
 //usage:	IF_FEATURE_TAR_FROM(
 //usage:	IF_FEATURE_TAR_LONG_OPTIONS(
 //usage:     "\n	exclude	File to exclude"
@@ -921,6 +1071,7 @@ enum {
 	IF_FEATURE_SEAMLESS_XZ(  OPTBIT_XZ          ,) // 16th bit
 	IF_FEATURE_SEAMLESS_Z(   OPTBIT_COMPRESS    ,)
 	IF_FEATURE_TAR_NOPRESERVE_TIME(OPTBIT_NOPRESERVE_TIME,)
+	IF_FEATURE_TAR_SPARSE(   OPTBIT_SPARSE      ,)
 #if ENABLE_FEATURE_TAR_LONG_OPTIONS
 	OPTBIT_NORECURSION,
 	IF_FEATURE_TAR_TO_COMMAND(OPTBIT_2COMMAND   ,)
@@ -947,6 +1098,7 @@ enum {
 	OPT_XZ           = IF_FEATURE_SEAMLESS_XZ(  (1 << OPTBIT_XZ          )) + 0, // J
 	OPT_COMPRESS     = IF_FEATURE_SEAMLESS_Z(   (1 << OPTBIT_COMPRESS    )) + 0, // Z
 	OPT_NOPRESERVE_TIME = IF_FEATURE_TAR_NOPRESERVE_TIME((1 << OPTBIT_NOPRESERVE_TIME)) + 0, // m
+	OPT_SPARSE       = IF_FEATURE_TAR_SPARSE(   (1 << OPTBIT_SPARSE      )) + 0, // S
 	OPT_NORECURSION     = IF_FEATURE_TAR_LONG_OPTIONS((1 << OPTBIT_NORECURSION    )) + 0, // no-recursion
 	OPT_2COMMAND        = IF_FEATURE_TAR_TO_COMMAND(  (1 << OPTBIT_2COMMAND       )) + 0, // to-command
 	OPT_NUMERIC_OWNER   = IF_FEATURE_TAR_LONG_OPTIONS((1 << OPTBIT_NUMERIC_OWNER  )) + 0, // numeric-owner
@@ -994,6 +1146,9 @@ static const char tar_longopts[] ALIGN1 =
 # endif
 # if ENABLE_FEATURE_TAR_NOPRESERVE_TIME
 	"touch\0"               No_argument       "m"
+# endif
+# if ENABLE_FEATURE_TAR_SPARSE
+	"sparse\0"              No_argument       "S"
 # endif
 	"no-recursion\0"	No_argument       "\xfa"
 # if ENABLE_FEATURE_TAR_TO_COMMAND
@@ -1085,6 +1240,7 @@ int tar_main(int argc UNUSED_PARAM, char **argv)
 		IF_FEATURE_SEAMLESS_XZ(  "J"   )
 		IF_FEATURE_SEAMLESS_Z(   "Z"   )
 		IF_FEATURE_TAR_NOPRESERVE_TIME("m")
+		IF_FEATURE_TAR_SPARSE(   "S"   )
 		, &base_dir // -C dir
 		, &tar_filename // -f filename
 		IF_FEATURE_TAR_FROM(, &(tar_handle->accept)) // T
@@ -1140,6 +1296,9 @@ int tar_main(int argc UNUSED_PARAM, char **argv)
 	if (opt & OPT_NOPRESERVE_TIME)
 		tar_handle->ah_flags &= ~ARCHIVE_RESTORE_DATE;
 
+	if (opt & OPT_SPARSE)
+		tar_handle->ah_flags |= ARCHIVE_STORE_SPARSE;
+
 #if ENABLE_FEATURE_TAR_FROM
 	tar_handle->reject = append_file_list_to_list(tar_handle->reject);
 # if ENABLE_FEATURE_TAR_LONG_OPTIONS
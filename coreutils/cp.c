@@ -31,6 +31,15 @@
 //usage:     "\n	-f	Overwrite"
 //usage:     "\n	-i	Prompt before overwrite"
 //usage:     "\n	-l,-s	Create (sym)links"
+//usage:	IF_FEATURE_CP_PARALLEL(
+//usage:     "\n	-j N	Copy file data with N processes"
+//usage:	)
+//usage:	IF_FEATURE_CP_REFLINK(
+//usage:     "\n	--reflink[=always|auto|never]	Clone file data if possible"
+//usage:	)
+//usage:	IF_FEATURE_CP_LONG_OPTIONS(
+//usage:     "\n	--sparse=always|auto|never	Make holes in DEST"
+//usage:	)
 
 #include "libbb.h"
 #include "libcoreutils/coreutils.h"
@@ -47,14 +56,28 @@ int cp_main(int argc, char **argv)
 	int s_flags;
 	int d_flags;
 	int flags;
+	unsigned opts;
 	int status;
+	IF_FEATURE_CP_PARALLEL(int opt_j = 1;)
+	IF_FEATURE_CP_REFLINK(const char *reflink = NULL;)
+	IF_FEATURE_CP_LONG_OPTIONS(const char *sparse;)
 	enum {
 		OPT_a = 1 << (sizeof(FILEUTILS_CP_OPTSTR)-1),
 		OPT_r = 1 << (sizeof(FILEUTILS_CP_OPTSTR)),
 		OPT_P = 1 << (sizeof(FILEUTILS_CP_OPTSTR)+1),
 		OPT_v = 1 << (sizeof(FILEUTILS_CP_OPTSTR)+2),
+		OPTBIT_j = sizeof(FILEUTILS_CP_OPTSTR)+3,
+		OPTBIT_parents = OPTBIT_j + ENABLE_FEATURE_CP_PARALLEL,
+#if ENABLE_FEATURE_CP_LONG_OPTIONS
+		OPT_parents = 1 << OPTBIT_parents,
+#endif
+		OPTBIT_reflink = OPTBIT_parents + 1,
+		OPTBIT_sparse = OPTBIT_reflink + ENABLE_FEATURE_CP_REFLINK,
+#if ENABLE_FEATURE_CP_REFLINK
+		OPT_reflink = 1 << OPTBIT_reflink,
+#endif
 #if ENABLE_FEATURE_CP_LONG_OPTIONS
-		OPT_parents = 1 << (sizeof(FILEUTILS_CP_OPTSTR)+3),
+		OPT_sparse = 1 << OPTBIT_sparse,
 #endif
 	};
 
@@ -64,7 +87,7 @@ int cp_main(int argc, char **argv)
 	// -r and -R are the same
 	// -R (and therefore -r) turns on -d (coreutils does this)
 	// -a = -pdR
-	opt_complementary = "-2:l--s:s--l:Pd:rRd:Rd:apdR";
+	opt_complementary = "-2:l--s:s--l:Pd:rRd:Rd:apdR" IF_FEATURE_CP_PARALLEL(":j+");
 #if ENABLE_FEATURE_CP_LONG_OPTIONS
 	applet_long_options =
 		"archive\0"        No_argument "a"
@@ -77,10 +100,18 @@ int cp_main(int argc, char **argv)
 		"symbolic-link\0"  No_argument "s"
 		"verbose\0"        No_argument "v"
 		"parents\0"        No_argument "\xff"
+		IF_FEATURE_CP_REFLINK(
+		"reflink\0"        Optional_argument "\xfe"
+		)
+		"sparse\0"         Required_argument "\xfd"
 		;
 #endif
 	// -v (--verbose) is ignored
-	flags = getopt32(argv, FILEUTILS_CP_OPTSTR "arPv");
+	opts = getopt32(argv, FILEUTILS_CP_OPTSTR "arPv" IF_FEATURE_CP_PARALLEL("j:")
+			IF_FEATURE_CP_PARALLEL(, &opt_j) IF_FEATURE_CP_REFLINK(, &reflink)
+			IF_FEATURE_CP_LONG_OPTIONS(, &sparse));
+	/* Only the bits of FILEUTILS_CP_OPTSTR are FILEUTILS_xxx flags */
+	flags = opts & ((1 << (sizeof(FILEUTILS_CP_OPTSTR)-1)) - 1);
 	/* Options of cp from GNU coreutils 6.10:
 	 * -a, --archive
 	 * -f, --force
@@ -97,6 +128,10 @@ int cp_main(int argc, char **argv)
 	 * -c	same as --preserve=context
 	 * --parents
 	 *	use full source file name under DIRECTORY
+	 * --reflink[=WHEN]
+	 *	control clone/CoW copies: always (default), auto, never
+	 * --sparse=WHEN
+	 *	control creation of sparse files: always, auto (default), never
 	 * NOT SUPPORTED IN BBOX:
 	 * --backup[=CONTROL]
 	 *	make a backup of each existing destination file
@@ -109,8 +144,6 @@ int cp_main(int argc, char **argv)
 	 * --no-preserve=ATTR_LIST
 	 * --remove-destination
 	 *	remove  each existing destination file before attempting to open
-	 * --sparse=WHEN
-	 *	control creation of sparse files
 	 * --strip-trailing-slashes
 	 *	remove any trailing slashes from each SOURCE argument
 	 * -S, --suffix=SUFFIX
@@ -143,6 +176,44 @@ int cp_main(int argc, char **argv)
 		selinux_or_die();
 	}
 #endif
+#if ENABLE_FEATURE_CP_REFLINK
+	if (opts & OPT_reflink) {
+		/* --reflink without =WHEN is "always", as in coreutils */
+		switch (reflink ? index_in_strings("never\0auto\0always\0", reflink) : 2) {
+		case 0:
+			break;
+		case 1:
+			flags |= FILEUTILS_REFLINK;
+			break;
+		case 2:
+			flags |= FILEUTILS_REFLINK | FILEUTILS_REFLINK_ALWAYS;
+			break;
+		default:
+			bb_error_msg_and_die("invalid argument '%s' for '%s'", reflink, "--reflink");
+		}
+	}
+#endif
+	/* Like coreutils, recreate holes if the source has them */
+	flags |= FILEUTILS_SPARSE;
+#if ENABLE_FEATURE_CP_LONG_OPTIONS
+	if (opts & OPT_sparse) {
+		switch (index_in_strings("never\0auto\0always\0", sparse)) {
+		case 0:
+			flags &= ~FILEUTILS_SPARSE;
+			break;
+		case 1:
+			break;
+		case 2:
+			flags |= FILEUTILS_SPARSE_ALWAYS;
+			break;
+		default:
+			bb_error_msg_and_die("invalid argument '%s' for '%s'", sparse, "--sparse");
+		}
+	}
+#endif
+#if ENABLE_FEATURE_CP_PARALLEL
+	copy_file_set_jobs(opt_j);
+#endif
 
 	status = EXIT_SUCCESS;
 	last = argv[argc - 1];
@@ -157,7 +228,7 @@ int cp_main(int argc, char **argv)
 			return EXIT_FAILURE;
 
 #if ENABLE_FEATURE_CP_LONG_OPTIONS
-		if (flags & OPT_parents) {
+		if (opts & OPT_parents) {
 			if (!(d_flags & 2)) {
 				bb_error_msg_and_die("with --parents, the destination must be a directory");
 			}
@@ -177,7 +248,7 @@ int cp_main(int argc, char **argv)
 
 	while (1) {
 #if ENABLE_FEATURE_CP_LONG_OPTIONS
-		if (flags & OPT_parents) {
+		if (opts & OPT_parents) {
 			char *dest_dup;
 			char *dest_dir;
 			dest = concat_path_file(last, *argv);
@@ -202,6 +273,10 @@ int cp_main(int argc, char **argv)
 		/* don't move up: dest may be == last and not malloced! */
 		free((void*)dest);
 	}
+#if ENABLE_FEATURE_CP_PARALLEL
+	if (copy_file_wait_jobs() < 0)
+		status = EXIT_FAILURE;
+#endif
 
 	/* Exit. We are NOEXEC, not NOFORK. We do exit at the end of main() */
 	return status;
@@ -11,6 +11,8 @@
 //usage:#define dd_trivial_usage
 //usage:       "[if=FILE] [of=FILE] " IF_FEATURE_DD_IBS_OBS("[ibs=N] [obs=N] ") "[bs=N] [count=N] [skip=N]\n"
 //usage:       "	[seek=N]" IF_FEATURE_DD_IBS_OBS(" [conv=notrunc|noerror|sync|fsync]")
+//usage:	IF_FEATURE_DD_DIRECT_IO("\n	[iflag=direct] [oflag=direct] [iodepth=N]")
+//usage:	IF_FEATURE_DD_LATENCY(" [status=latency]")
 //usage:#define dd_full_usage "\n\n"
 //usage:       "Copy a file with converting and formatting\n"
 //usage:     "\n	if=FILE		Read from FILE instead of stdin"
@@ -31,6 +33,16 @@
 //usage:     "\n	conv=sync	Pad blocks with zeros"
 //usage:     "\n	conv=fsync	Physically write data out before finishing"
 //usage:     "\n	conv=swab	Swap every pair of bytes"
+//usage:     "\n	conv=sparse	Seek over all-zero output blocks,"
+//usage:     "\n			don't read holes of input file"
+//usage:	)
+//usage:	IF_FEATURE_DD_DIRECT_IO(
+//usage:     "\n	iflag=direct	Read bypassing page cache (O_DIRECT)"
+//usage:     "\n	oflag=direct	Write bypassing page cache (O_DIRECT)"
+//usage:     "\n	iodepth=N	Read up to N blocks ahead while writing"
+//usage:	)
+//usage:	IF_FEATURE_DD_LATENCY(
+//usage:     "\n	status=latency	Show read and write latency percentiles"
 //usage:	)
 //usage:     "\n"
 //usage:     "\nN may be suffixed by c (1), w (2), b (512), kD (1000), k (1024), MD, M, GD, G"
@@ -66,10 +78,33 @@ static const struct suffix_mult dd_suffixes[] = {
 
 struct globals {
 	off_t out_full, out_part, in_full, in_part;
+#if ENABLE_FEATURE_DD_IBS_OBS
+	smallint sparse;     /* conv=sparse */
+	smallint last_seek;  /* last output block was seeked over */
+#endif
+#if ENABLE_FEATURE_DD_DIRECT_IO
+	smallint odirect;    /* oflag=direct, not yet turned off */
+	unsigned depth;      /* iodepth=N */
+# if BB_MMU
+	/* Read-ahead ring shared with the reader process */
+	char *ring;
+	size_t slot_size;
+	unsigned ring_cur;
+	smallint ring_busy;  /* we hold ring[ring_cur] */
+	int full_fd;         /* reader -> us: results of reads */
+	int free_fd;         /* us -> reader: a slot is free again */
+	pid_t reader;
+# endif
+#endif
 #if ENABLE_FEATURE_DD_THIRD_STATUS_LINE
 	unsigned long long total_bytes;
 	unsigned long long begin_time_us;
 #endif
+#if ENABLE_FEATURE_DD_LATENCY
+	/* status=latency: histograms of read [0] and write [1] times */
+	unsigned *lat_hist;
+	unsigned lat_max[2];
+#endif
 } FIX_ALIASING;
 #define G (*(struct globals*)&bb_common_bufsiz1)
 #define INIT_G() do { \
@@ -78,6 +113,69 @@ struct globals {
 } while (0)
 
 
+#if ENABLE_FEATURE_DD_LATENCY
+/* Log-linear histogram: values below 16 us are exact, above that
+ * every power of 2 is split into 8 buckets, i.e. error is < 12.5% */
+enum { LAT_BUCKETS = 30 * 8 };
+
+static unsigned lat_bucket(unsigned us)
+{
+	unsigned e;
+
+	if (us < 16)
+		return us;
+	e = 4;
+	while (us >> (e + 1))
+		e++;
+	return (e - 2) * 8 + ((us >> (e - 3)) & 7);
+}
+
+/* Largest value which falls into bucket b */
+static unsigned lat_bucket_top(unsigned b)
+{
+	b++;
+	if (b <= 16)
+		return b - 1;
+	return ((8u + (b & 7)) << (b / 8 - 1)) - 1;
+}
+
+static void lat_add(int which, unsigned long long us)
+{
+	unsigned v = us > UINT_MAX ? UINT_MAX : us;
+
+	G.lat_hist[which * LAT_BUCKETS + lat_bucket(v)]++;
+	if (G.lat_max[which] < v)
+		G.lat_max[which] = v;
+}
+
+static void lat_print(int which, const char *what)
+{
+	static const unsigned short permille[] = { 500, 900, 990, 999 };
+	const unsigned *hist = G.lat_hist + which * LAT_BUCKETS;
+	unsigned long long ops, sum, want;
+	unsigned b, i;
+
+	ops = 0;
+	for (b = 0; b < LAT_BUCKETS; b++)
+		ops += hist[b];
+	if (ops == 0)
+		return;
+	fprintf(stderr, "%s latency: %llu ops, us", what, ops);
+	b = 0;
+	sum = hist[0];
+	for (i = 0; i < ARRAY_SIZE(permille); i++) {
+		want = (ops * permille[i] + 999) / 1000;
+		while (sum < want)
+			sum += hist[++b];
+		fprintf(stderr, " p%u", permille[i] / 10);
+		if (permille[i] % 10)
+			fprintf(stderr, ".%u", permille[i] % 10);
+		fprintf(stderr, " %u", MIN(lat_bucket_top(b), G.lat_max[which]));
+	}
+	fprintf(stderr, " max %u\n", G.lat_max[which]);
+}
+#endif
+
 static void dd_output_status(int UNUSED_PARAM cur_signal)
 {
 #if ENABLE_FEATURE_DD_THIRD_STATUS_LINE
@@ -112,12 +210,40 @@ static void dd_output_status(int UNUSED_PARAM cur_signal)
 			make_human_readable_str(bytes_sec, 1, 0)
 	);
 #endif
+#if ENABLE_FEATURE_DD_LATENCY
+	if (G.lat_hist) {
+		lat_print(0, "read");
+		lat_print(1, "write");
+	}
+#endif
+}
+
+static ssize_t read_timed(void *buf, size_t len)
+{
+#if ENABLE_FEATURE_DD_LATENCY
+	if (G.lat_hist) {
+		unsigned long long t = monotonic_us();
+		ssize_t n = safe_read(ifd, buf, len);
+		lat_add(0, monotonic_us() - t);
+		return n;
+	}
+#endif
+	return safe_read(ifd, buf, len);
 }
 
 static ssize_t full_write_or_warn(const void *buf, size_t len,
 	const char *const filename)
 {
-	ssize_t n = full_write(ofd, buf, len);
+	ssize_t n;
+#if ENABLE_FEATURE_DD_LATENCY
+	unsigned long long t = G.lat_hist ? monotonic_us() : 0;
+#endif
+
+	n = full_write(ofd, buf, len);
+#if ENABLE_FEATURE_DD_LATENCY
+	if (G.lat_hist)
+		lat_add(1, monotonic_us() - t);
+#endif
 	if (n < 0)
 		bb_perror_msg("writing '%s'", filename);
 	return n;
@@ -126,7 +252,28 @@ static ssize_t full_write_or_warn(const void *buf, size_t len,
 static bool write_and_stats(const void *buf, size_t len, size_t obs,
 	const char *filename)
 {
-	ssize_t n = full_write_or_warn(buf, len, filename);
+	ssize_t n;
+
+#if ENABLE_FEATURE_DD_IBS_OBS
+	G.last_seek = 0;
+	if (G.sparse && len == obs && is_zero_block(buf, len)
+	 && lseek(ofd, len, SEEK_CUR) >= 0
+	) {
+		G.last_seek = 1;
+		n = len;
+	} else
+#endif
+	{
+#if ENABLE_FEATURE_DD_DIRECT_IO
+		/* O_DIRECT wants whole blocks. Like GNU dd,
+		 * write the short tail through page cache */
+		if (G.odirect && len < obs) {
+			G.odirect = 0;
+			fcntl(ofd, F_SETFL, fcntl(ofd, F_GETFL) & ~O_DIRECT);
+		}
+#endif
+		n = full_write_or_warn(buf, len, filename);
+	}
 	if (n < 0)
 		return 1;
 	if ((size_t)n == obs)
@@ -139,6 +286,152 @@ static bool write_and_stats(const void *buf, size_t len, size_t obs,
 	return 0;
 }
 
+#if ENABLE_FEATURE_DD_DIRECT_IO
+/* O_DIRECT needs aligned buffers, mmap gives page-aligned ones */
+static void *mmap_buf(size_t size, int shared)
+{
+	void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			(shared ? MAP_SHARED : MAP_PRIVATE) | MAP_ANON,
+			/* ignored: */ -1, 0);
+	if (p == MAP_FAILED)
+		bb_error_msg_and_die(bb_msg_memory_exhausted);
+	return p;
+}
+# define alloc_buf(size)   mmap_buf(size, 0)
+# define free_buf(p, size) munmap(p, size)
+
+static void set_direct(int fd, const char *filename)
+{
+	if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_DIRECT) < 0)
+		bb_perror_msg_and_die("can't use O_DIRECT on '%s'", filename);
+}
+#else
+# define alloc_buf(size)   xmalloc(size)
+# define free_buf(p, size) free(p)
+#endif
+
+#if ENABLE_FEATURE_DD_DIRECT_IO && BB_MMU
+/* iodepth=N: a child process reads up to N blocks ahead into
+ * a shared ring while we write. Blocks are consumed in order,
+ * so pipes only need to carry read results one way
+ * and "slot is free" tokens the other way.
+ */
+struct read_result {
+	ssize_t n;
+	int err;
+	unsigned us;
+};
+
+static void NORETURN reader_loop(size_t ibs, int noerror, off_t count, int limited)
+{
+	struct read_result r;
+	unsigned i = 0, used = 0;
+	char c;
+
+	while (!limited || count-- != 0) {
+		unsigned long long t;
+
+		if (used == G.depth) {
+			/* Wait for the writer to free a slot */
+			if (safe_read(G.free_fd, &c, 1) != 1)
+				_exit(0);
+			used--;
+		}
+		t = monotonic_us();
+		r.n = safe_read(ifd, G.ring + i * G.slot_size, ibs);
+		r.us = monotonic_us() - t;
+		r.err = errno;
+		if (r.n < 0 && noerror) {
+			/* GNU dd with conv=noerror skips over bad blocks */
+			lseek(ifd, ibs, SEEK_CUR);
+		}
+		if (full_write(G.full_fd, &r, sizeof(r)) != sizeof(r))
+			_exit(0);
+		used++;
+		if (r.n == 0 || (r.n < 0 && !noerror))
+			break;
+		if (++i == G.depth)
+			i = 0;
+	}
+	/* Don't exit before the writer is done: it would get SIGPIPE */
+	while (safe_read(G.free_fd, &c, 1) == 1)
+		continue;
+	_exit(0);
+}
+
+static void start_reader(size_t ibs, int noerror, off_t count, int limited)
+{
+	struct fd_pair full, avail;
+
+	xpiped_pair(full);
+	xpiped_pair(avail);
+	G.reader = xfork();
+	if (G.reader == 0) {
+		close(full.rd);
+		close(avail.wr);
+		G.full_fd = full.wr;
+		G.free_fd = avail.rd;
+		IF_FEATURE_DD_SIGNAL_HANDLING(signal(SIGUSR1, SIG_IGN);)
+		reader_loop(ibs, noerror, count, limited);
+	}
+	close(full.wr);
+	close(avail.rd);
+	G.full_fd = full.rd;
+	G.free_fd = avail.wr;
+}
+
+static ssize_t ring_read(char **bufp)
+{
+	struct read_result r;
+
+	if (G.ring_busy) {
+		/* We are done with the previous block */
+		xwrite(G.free_fd, "", 1);
+		if (++G.ring_cur == G.depth)
+			G.ring_cur = 0;
+	}
+	if (full_read(G.full_fd, &r, sizeof(r)) != sizeof(r))
+		bb_error_msg_and_die("read-ahead process died");
+	G.ring_busy = 1;
+	*bufp = G.ring + G.ring_cur * G.slot_size;
+# if ENABLE_FEATURE_DD_LATENCY
+	if (G.lat_hist)
+		lat_add(0, r.us);
+# endif
+	errno = r.err;
+	return r.n;
+}
+#endif
+
+#if ENABLE_FEATURE_DD_IBS_OBS || ENABLE_FEATURE_DD_LATENCY
+/* "word1,word2": returns bitmask of their indexes in words */
+static int parse_comma_flags(char *val, const char *words, const char *error_in)
+{
+	int flags = 0;
+
+	while (1) {
+		int n;
+		char *arg;
+		/* find ',', replace them with NUL so we can use val for
+		 * index_in_strings() without copying.
+		 * We rely on val being non-null, else strchr would fault.
+		 */
+		arg = strchr(val, ',');
+		if (arg)
+			*arg = '\0';
+		n = index_in_strings(words, val);
+		if (n < 0)
+			bb_error_msg_and_die(bb_msg_invalid_arg, val, error_in);
+		flags |= (1 << n);
+		if (!arg) /* no ',' left, so this was the last specifier */
+			break;
+		/* *arg = ','; - to preserve ps listing? */
+		val = arg + 1; /* skip this keyword and ',' */
+	}
+	return flags;
+}
+#endif
+
 #if ENABLE_LFS
 # define XATOU_SFX xatoull_sfx
 #else
@@ -156,19 +449,28 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 		FLAG_NOERROR = (1 << 2) * ENABLE_FEATURE_DD_IBS_OBS,
 		FLAG_FSYNC   = (1 << 3) * ENABLE_FEATURE_DD_IBS_OBS,
 		FLAG_SWAB    = (1 << 4) * ENABLE_FEATURE_DD_IBS_OBS,
+		FLAG_SPARSE  = (1 << 5) * ENABLE_FEATURE_DD_IBS_OBS,
 		/* end of conv flags */
-		FLAG_TWOBUFS = (1 << 5) * ENABLE_FEATURE_DD_IBS_OBS,
-		FLAG_COUNT   = 1 << 6,
+		FLAG_TWOBUFS = (1 << 6) * ENABLE_FEATURE_DD_IBS_OBS,
+		FLAG_COUNT   = 1 << 7,
+		FLAG_IDIRECT = (1 << 8) * ENABLE_FEATURE_DD_DIRECT_IO,
+		FLAG_ODIRECT = (1 << 9) * ENABLE_FEATURE_DD_DIRECT_IO,
 	};
 	static const char keywords[] ALIGN1 =
 		"bs\0""count\0""seek\0""skip\0""if\0""of\0"
 #if ENABLE_FEATURE_DD_IBS_OBS
 		"ibs\0""obs\0""conv\0"
+#endif
+#if ENABLE_FEATURE_DD_DIRECT_IO
+		"iflag\0""oflag\0""iodepth\0"
+#endif
+#if ENABLE_FEATURE_DD_LATENCY
+		"status\0"
 #endif
 		;
 #if ENABLE_FEATURE_DD_IBS_OBS
 	static const char conv_words[] ALIGN1 =
-		"notrunc\0""sync\0""noerror\0""fsync\0""swab\0";
+		"notrunc\0""sync\0""noerror\0""fsync\0""swab\0""sparse\0";
 #endif
 	enum {
 		OP_bs = 0,
@@ -181,12 +483,23 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 		OP_ibs,
 		OP_obs,
 		OP_conv,
+#endif
+#if ENABLE_FEATURE_DD_DIRECT_IO
+		OP_iflag,
+		OP_oflag,
+		OP_iodepth,
+#endif
+#if ENABLE_FEATURE_DD_LATENCY
+		OP_status,
+#endif
+#if ENABLE_FEATURE_DD_IBS_OBS
 		/* Must be in the same order as FLAG_XXX! */
 		OP_conv_notrunc = 0,
 		OP_conv_sync,
 		OP_conv_noerror,
 		OP_conv_fsync,
 		OP_conv_swab,
+		OP_conv_sparse,
 	/* Unimplemented conv=XXX: */
 	//nocreat       do not create the output file
 	//excl          fail if the output file already exists
@@ -221,6 +534,11 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 		off_t count;
 		off_t seek, skip;
 		const char *infile, *outfile;
+#if ENABLE_FEATURE_DD_IBS_OBS
+		/* conv=sparse: input position, end of the hole we are in,
+		 * where to look for holes again */
+		off_t in_pos, hole_end, scan_end, in_size;
+#endif
 	} Z;
 #define flags   (Z.flags  )
 #define oc      (Z.oc     )
@@ -230,6 +548,10 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 #define skip    (Z.skip   )
 #define infile  (Z.infile )
 #define outfile (Z.outfile)
+#define in_pos   (Z.in_pos  )
+#define hole_end (Z.hole_end)
+#define scan_end (Z.scan_end)
+#define in_size  (Z.in_size )
 
 	memset(&Z, 0, sizeof(Z));
 	INIT_G();
@@ -266,24 +588,30 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 			/*continue;*/
 		}
 		if (what == OP_conv) {
-			while (1) {
-				int n;
-				/* find ',', replace them with NUL so we can use val for
-				 * index_in_strings() without copying.
-				 * We rely on val being non-null, else strchr would fault.
-				 */
-				arg = strchr(val, ',');
-				if (arg)
-					*arg = '\0';
-				n = index_in_strings(conv_words, val);
-				if (n < 0)
-					bb_error_msg_and_die(bb_msg_invalid_arg, val, "conv");
-				flags |= (1 << n);
-				if (!arg) /* no ',' left, so this was the last specifier */
-					break;
-				/* *arg = ','; - to preserve ps listing? */
-				val = arg + 1; /* skip this keyword and ',' */
-			}
+			flags |= parse_comma_flags(val, conv_words, "conv");
+			/*continue;*/
+		}
+#endif
+#if ENABLE_FEATURE_DD_DIRECT_IO
+		/* "direct" is the only flag, it is bit 0 */
+		if (what == OP_iflag) {
+			flags |= parse_comma_flags(val, "direct\0", "iflag") * FLAG_IDIRECT;
+			/*continue;*/
+		}
+		if (what == OP_oflag) {
+			flags |= parse_comma_flags(val, "direct\0", "oflag") * FLAG_ODIRECT;
+			/*continue;*/
+		}
+		if (what == OP_iodepth) {
+			G.depth = xatou_range(val, 1, 1024);
+			/*continue;*/
+		}
+#endif
+#if ENABLE_FEATURE_DD_LATENCY
+		if (what == OP_status) {
+			parse_comma_flags(val, "latency\0", "status");
+			if (!G.lat_hist)
+				G.lat_hist = xzalloc(2 * LAT_BUCKETS * sizeof(G.lat_hist[0]));
 			/*continue;*/
 		}
 #endif
@@ -317,12 +645,20 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 	} /* end of "for (argv[i])" */
 
 //XXX:FIXME for huge ibs or obs, malloc'ing them isn't the brightest idea ever
-	ibuf = xmalloc(ibs);
+#if ENABLE_FEATURE_DD_DIRECT_IO && BB_MMU
+	if (G.depth > 1) {
+		unsigned pagesize = getpagesize();
+		G.slot_size = (ibs + pagesize - 1) & ~(size_t)(pagesize - 1);
+		G.ring = mmap_buf(G.depth * G.slot_size, /*shared:*/ 1);
+		ibuf = G.ring;
+	} else
+#endif
+	ibuf = alloc_buf(ibs);
 	obuf = ibuf;
 #if ENABLE_FEATURE_DD_IBS_OBS
 	if (ibs != obs) {
 		flags |= FLAG_TWOBUFS;
-		obuf = xmalloc(obs);
+		obuf = alloc_buf(obs);
 	}
 #endif
 
@@ -338,6 +674,10 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 	} else {
 		infile = bb_msg_standard_input;
 	}
+#if ENABLE_FEATURE_DD_DIRECT_IO
+	if (flags & FLAG_IDIRECT)
+		set_direct(ifd, infile);
+#endif
 	if (outfile) {
 		int oflag = O_WRONLY | O_CREAT;
 
@@ -361,6 +701,12 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 	} else {
 		outfile = bb_msg_standard_output;
 	}
+#if ENABLE_FEATURE_DD_DIRECT_IO
+	if (flags & FLAG_ODIRECT) {
+		set_direct(ofd, outfile);
+		G.odirect = 1;
+	}
+#endif
 	if (skip) {
 		if (lseek(ifd, skip * ibs, SEEK_CUR) < 0) {
 			do {
@@ -376,20 +722,86 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 		if (lseek(ofd, seek * obs, SEEK_CUR) < 0)
 			goto die_outfile;
 	}
+#if ENABLE_FEATURE_DD_IBS_OBS
+	G.sparse = (flags & FLAG_SPARSE) != 0;
+	in_pos = -1;
+	if (G.sparse && !(flags & FLAG_TWOBUFS)
+	 IF_FEATURE_DD_DIRECT_IO(&& G.depth <= 1)
+	) {
+		struct stat st;
+		/* Holes of a regular input file can be skipped without reading,
+		 * if we can seek in the output too */
+		if (fstat(ifd, &st) == 0 && S_ISREG(st.st_mode)
+		 && lseek(ofd, 0, SEEK_CUR) >= 0
+		) {
+			in_size = st.st_size;
+			in_pos = lseek(ifd, 0, SEEK_CUR);
+		}
+	}
+#endif
+#if ENABLE_FEATURE_DD_DIRECT_IO && BB_MMU
+	if (G.ring)
+		start_reader(ibs, flags & FLAG_NOERROR, count, flags & FLAG_COUNT);
+#endif
 
 	while (!(flags & FLAG_COUNT) || (G.in_full + G.in_part != count)) {
 		ssize_t n;
 
-		n = safe_read(ifd, ibuf, ibs);
+#if ENABLE_FEATURE_DD_IBS_OBS && defined(SEEK_HOLE)
+		if (in_pos >= 0) {
+			if (in_pos >= scan_end) {
+				/* Are we in a hole? Where does it (or data) end? */
+				hole_end = lseek(ifd, in_pos, SEEK_DATA);
+				if (hole_end < 0) /* ENXIO: hole up to EOF */
+					hole_end = (errno == ENXIO) ? in_size : in_pos;
+				scan_end = hole_end;
+				if (hole_end == in_pos)
+					scan_end = lseek(ifd, in_pos, SEEK_HOLE);
+				if (scan_end <= in_pos || lseek(ifd, in_pos, SEEK_SET) < 0) {
+					/* SEEK_DATA/HOLE don't work here */
+					xlseek(ifd, in_pos, SEEK_SET);
+					in_pos = -1;
+					goto do_read;
+				}
+			}
+			if (hole_end - in_pos >= (off_t)ibs) {
+				/* Whole block of hole: seek over it on both sides */
+				xlseek(ifd, ibs, SEEK_CUR);
+				if (lseek(ofd, ibs, SEEK_CUR) < 0)
+					goto die_outfile;
+				in_pos += ibs;
+				G.in_full++;
+				G.out_full++;
+				IF_FEATURE_DD_THIRD_STATUS_LINE(G.total_bytes += ibs;)
+				G.last_seek = 1;
+				continue;
+			}
+		}
+ do_read:
+#endif
+#if ENABLE_FEATURE_DD_DIRECT_IO && BB_MMU
+		if (G.ring)
+			n = ring_read(&ibuf);
+		else
+#endif
+		n = read_timed(ibuf, ibs);
 		if (n == 0)
 			break;
+#if ENABLE_FEATURE_DD_IBS_OBS
+		if (in_pos >= 0)
+			in_pos = (n > 0) ? in_pos + n : -1;
+#endif
 		if (n < 0) {
 			/* "Bad block" */
 			if (!(flags & FLAG_NOERROR))
 				goto die_infile;
 			bb_simple_perror_msg(infile);
-			/* GNU dd with conv=noerror skips over bad blocks */
-			xlseek(ifd, ibs, SEEK_CUR);
+			/* GNU dd with conv=noerror skips over bad blocks
+			 * (reader process does it for us if iodepth > 1) */
+#if ENABLE_FEATURE_DD_DIRECT_IO && BB_MMU
+			if (!G.ring)
+#endif
+				xlseek(ifd, ibs, SEEK_CUR);
 			/* conv=noerror,sync writes NULs,
 			 * conv=noerror just ignores input bad blocks */
 			n = 0;
@@ -456,6 +868,25 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 		if (write_and_stats(obuf, oc, obs, outfile))
 			goto out_status;
 	}
+#if ENABLE_FEATURE_DD_IBS_OBS
+	if (G.last_seek) {
+		/* We seeked past EOF, make output file that long */
+		struct stat st;
+		off_t pos = xlseek(ofd, 0, SEEK_CUR);
+		if (fstat(ofd, &st) == 0 && S_ISREG(st.st_mode)
+		 && st.st_size < pos && ftruncate(ofd, pos) < 0
+		) {
+			goto die_outfile;
+		}
+	}
+#endif
+#if ENABLE_FEATURE_DD_DIRECT_IO && BB_MMU
+	if (G.ring) {
+		/* Let the reader exit */
+		close(G.free_fd);
+		safe_waitpid(G.reader, NULL, 0);
+	}
+#endif
 	if (close(ifd) < 0) {
  die_infile:
 		bb_simple_perror_msg_and_die(infile);
@@ -471,9 +902,16 @@ int dd_main(int argc UNUSED_PARAM, char **argv)
 	dd_output_status(0);
 
 	if (ENABLE_FEATURE_CLEAN_UP) {
-		free(obuf);
 		if (flags & FLAG_TWOBUFS)
-			free(ibuf);
+			free_buf(obuf, obs);
+#if ENABLE_FEATURE_DD_DIRECT_IO && BB_MMU
+		/* ibuf points somewhere into the ring */
+		if (G.ring)
+			free_buf(G.ring, G.depth * G.slot_size);
+		else
+#endif
+		free_buf(ibuf, ibs);
+		IF_FEATURE_DD_LATENCY(free(G.lat_hist);)
 	}
 
 	return exitcode;
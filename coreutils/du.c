@@ -24,7 +24,7 @@
  */
 
 //usage:#define du_trivial_usage
-//usage:       "[-aHLdclsx" IF_FEATURE_HUMAN_READABLE("hm") "k] [FILE]..."
+//usage:       "[-aHLdclsx" IF_FEATURE_HUMAN_READABLE("hm") "k]" IF_FEATURE_DU_PARALLEL(" [-j N]") " [FILE]..."
 //usage:#define du_full_usage "\n\n"
 //usage:       "Summarize disk space used for each FILE and/or directory\n"
 //usage:     "\n	-a	Show file sizes too"
@@ -35,6 +35,9 @@
 //usage:     "\n	-l	Count sizes many times if hard linked"
 //usage:     "\n	-s	Display only a total for each argument"
 //usage:     "\n	-x	Skip directories on different filesystems"
+//usage:	IF_FEATURE_DU_PARALLEL(
+//usage:     "\n	-j N	Walk subdirectories with N processes"
+//usage:	)
 //usage:	IF_FEATURE_HUMAN_READABLE(
 //usage:     "\n	-h	Sizes in human readable format (e.g., 1K 243M 2G)"
 //usage:     "\n	-m	Sizes in megabytes"
@@ -84,6 +87,17 @@ struct globals {
 	int slink_depth;
 	int du_depth;
 	dev_t dir_dev;
+#if ENABLE_FEATURE_DU_PARALLEL
+	unsigned job_max;
+	unsigned job_cnt;
+	unsigned job_replayed;
+	unsigned walker_cnt;
+	unsigned dirs_size;
+	FILE *out;
+	struct du_job *jobs;
+	struct du_walker *walkers;
+	struct du_dir *dirs;
+#endif
 } FIX_ALIASING;
 #define G (*(struct globals*)&bb_common_bufsiz1)
 #define INIT_G() do { } while (0)
@@ -189,12 +203,392 @@ static unsigned long long du(const char *filename)
 	return sum;
 }
 
+#if ENABLE_FEATURE_DU_PARALLEL
+/* du -j N: the directories at depth JOB_DEPTH are walked by N child
+ * processes, so that many lstat() and getdents() requests are in flight.
+ * Walker i takes every N-th subtree, in order. It does not count or
+ * print anything: it writes what it finds to its temporary file, in the
+ * order du() visits it, and writes a byte to its pipe after each subtree.
+ * The parent walks the top levels the same way, then replays all records
+ * in du() order, doing hardlink de-duplication, summing and printing just
+ * as du() would. The ino/dev table is only used by the parent.
+ */
+enum { JOB_DEPTH = 2 };
+
+enum {
+	R_ENTRY,        /* lstat result of a file or directory */
+	R_ERR,          /* lstat/stat failed */
+	R_SKIP,         /* -x: on another filesystem */
+	R_DIRERR,       /* opendir failed */
+	R_JOB,          /* subtree is in the next job's records */
+	R_END,          /* end of directory */
+};
+
+struct du_rec {
+	unsigned long long blocks;
+	dev_t dev;
+	ino_t ino;
+	int err;
+	unsigned char type;
+	unsigned char is_dir;
+	unsigned char multi_link;
+	unsigned char namelen;
+	char name[NAME_MAX + 1]; /* not written past namelen */
+};
+#define REC_HDR_SIZE offsetof(struct du_rec, name)
+
+/* Parent reads records with pread(): a walker writes at the file offset */
+struct du_in {
+	int fd;
+	unsigned idx;
+	unsigned len;
+	off_t pos;
+	char buf[64 * 1024];
+};
+
+struct du_dir {
+	dev_t dev;
+	ino_t ino;
+};
+
+struct du_job {
+	char *path;
+	struct du_dir parents[JOB_DEPTH];
+};
+
+struct du_walker {
+	pid_t pid;
+	int done_fd;
+	FILE *fp;
+	struct du_in in;
+};
+
+static void put_rec(struct du_rec *r, const char *name)
+{
+	r->namelen = strlen(name);
+	fwrite(r, REC_HDR_SIZE, 1, G.out);
+	fwrite(name, r->namelen, 1, G.out);
+}
+
+static void get_bytes(struct du_in *in, void *p, unsigned n)
+{
+	while (n) {
+		unsigned cnt;
+
+		if (in->idx == in->len) {
+			ssize_t r = pread(in->fd, in->buf, sizeof(in->buf), in->pos);
+			if (r <= 0)
+				bb_error_msg_and_die("short read");
+			in->pos += r;
+			in->idx = 0;
+			in->len = r;
+		}
+		cnt = in->len - in->idx;
+		if (cnt > n)
+			cnt = n;
+		memcpy(p, in->buf + in->idx, cnt);
+		in->idx += cnt;
+		p = (char*)p + cnt;
+		n -= cnt;
+	}
+}
+
+static void get_rec(struct du_rec *r, struct du_in *in)
+{
+	get_bytes(in, r, REC_HDR_SIZE);
+	get_bytes(in, r->name, r->namelen);
+	r->name[r->namelen] = '\0';
+}
+
+static FILE *xtmpfile(void)
+{
+	FILE *fp = tmpfile();
+	if (!fp)
+		bb_perror_msg_and_die("can't create temporary file");
+	return fp;
+}
+
+/* Same checks as du(), in the same order, but only record the results */
+static void du_walk(const char *filename, const char *name)
+{
+	struct stat statbuf;
+	struct du_rec r;
+	DIR *dir;
+	struct dirent *entry;
+
+	memset(&r, 0, REC_HDR_SIZE);
+	if (lstat(filename, &statbuf) != 0)
+		goto err;
+	if (option_mask32 & OPT_x_one_FS) {
+		if (G.du_depth == 0) {
+			G.dir_dev = statbuf.st_dev;
+		} else if (G.dir_dev != statbuf.st_dev) {
+			r.type = R_SKIP;
+			put_rec(&r, name);
+			return;
+		}
+	}
+	if (S_ISLNK(statbuf.st_mode)) {
+		if (G.slink_depth > G.du_depth) { /* -H or -L */
+			if (stat(filename, &statbuf) != 0)
+				goto err;
+			if (G.slink_depth == 1) {
+				/* Convert -H to -L */
+				G.slink_depth = INT_MAX;
+			}
+		}
+	}
+	r.type = R_ENTRY;
+	r.blocks = statbuf.st_blocks;
+	r.dev = statbuf.st_dev;
+	r.ino = statbuf.st_ino;
+	r.multi_link = (statbuf.st_nlink > 1);
+	r.is_dir = S_ISDIR(statbuf.st_mode);
+	put_rec(&r, name);
+	if (!r.is_dir)
+		return;
+
+	if (!(option_mask32 & OPT_l_hardlinks) && r.multi_link) {
+		/* A loop (-L, bind mounts)? The parent finds this directory
+		 * in the ino/dev table and skips it too. Other directories
+		 * seen before are walked again: the parent may not have
+		 * seen them, if it skipped something we didn't */
+		int i;
+		for (i = 0; i < G.du_depth; i++) {
+			if (G.dirs[i].dev == r.dev && G.dirs[i].ino == r.ino)
+				goto end;
+		}
+	}
+	if (G.du_depth >= G.dirs_size) {
+		G.dirs_size = G.du_depth + 16;
+		G.dirs = xrealloc(G.dirs, G.dirs_size * sizeof(G.dirs[0]));
+	}
+	G.dirs[G.du_depth].dev = r.dev;
+	G.dirs[G.du_depth].ino = r.ino;
+
+	dir = opendir(filename);
+	if (!dir) {
+		r.type = R_DIRERR;
+		r.err = errno;
+		put_rec(&r, "");
+		goto end;
+	}
+	while ((entry = readdir(dir))) {
+		char *newfile = concat_subpath_file(filename, entry->d_name);
+		if (newfile == NULL)
+			continue;
+		++G.du_depth;
+		if (!G.walkers && G.du_depth == JOB_DEPTH && entry->d_type == DT_DIR) {
+			/* Parent: leave it to a walker */
+			G.jobs = xrealloc_vector(G.jobs, 4, G.job_cnt);
+			G.jobs[G.job_cnt].path = newfile;
+			memcpy(G.jobs[G.job_cnt].parents, G.dirs, sizeof(G.jobs[0].parents));
+			G.job_cnt++;
+			r.type = R_JOB;
+			put_rec(&r, entry->d_name);
+		} else {
+			du_walk(newfile, entry->d_name);
+			free(newfile);
+		}
+		--G.du_depth;
+	}
+	closedir(dir);
+ end:
+	r.type = R_END;
+	put_rec(&r, "");
+	return;
+ err:
+	r.type = R_ERR;
+	r.err = errno;
+	put_rec(&r, name);
+}
+
+static void start_walkers(void)
+{
+	unsigned i, n;
+
+	n = G.job_cnt < G.job_max ? G.job_cnt : G.job_max;
+	G.walkers = xzalloc(n * sizeof(G.walkers[0]));
+	G.walker_cnt = n;
+	for (i = 0; i < n; i++) {
+		struct du_walker *w = &G.walkers[i];
+		FILE *fp = xtmpfile();
+		struct fd_pair done;
+		unsigned k;
+
+		xpiped_pair(done);
+		w->pid = xfork();
+		if (w->pid == 0) {
+			close(done.rd);
+			G.out = fp;
+			for (k = i; k < G.job_cnt; k += n) {
+				G.du_depth = JOB_DEPTH;
+				memcpy(G.dirs, G.jobs[k].parents, sizeof(G.jobs[k].parents));
+				du_walk(G.jobs[k].path, "");
+				if (fflush(fp) != 0 || full_write(done.wr, "", 1) != 1)
+					_exit(EXIT_FAILURE);
+			}
+			/* Not exit(): stdout may hold parent's output */
+			_exit(EXIT_SUCCESS);
+		}
+		close(done.wr);
+		w->done_fd = done.rd;
+		w->fp = fp;
+		w->in.fd = fileno(fp);
+	}
+}
+
+static void skip_dir(struct du_rec *r, struct du_in *in);
+
+/* Wait until the next job's records are written, return them */
+static struct du_in *next_job(void)
+{
+	unsigned k = G.job_replayed++;
+	struct du_walker *w = &G.walkers[k % G.walker_cnt];
+	char c;
+
+	if (safe_read(w->done_fd, &c, 1) != 1)
+		bb_error_msg_and_die("can't walk '%s'", G.jobs[k].path);
+	free(G.jobs[k].path);
+	return &w->in;
+}
+
+/* du() working on records instead of the filesystem */
+static unsigned long long replay(const char *filename, struct du_rec *r, struct du_in *in)
+{
+	unsigned long long sum;
+
+	if (r->type == R_ERR) {
+		errno = r->err;
+		bb_simple_perror_msg(filename);
+		G.status = EXIT_FAILURE;
+		return 0;
+	}
+	if (r->type == R_SKIP)
+		return 0;
+
+	sum = r->blocks;
+
+	if (!(option_mask32 & OPT_l_hardlinks)
+	 && r->multi_link
+	) {
+		struct stat statbuf;
+
+		statbuf.st_dev = r->dev;
+		statbuf.st_ino = r->ino;
+		/* Add files/directories with links only once */
+		if (is_in_ino_dev_hashtable(&statbuf)) {
+			if (r->is_dir)
+				skip_dir(r, in);
+			return 0;
+		}
+		add_to_ino_dev_hashtable(&statbuf, NULL);
+	}
+
+	if (r->is_dir) {
+		bool failed = 0;
+
+		while (get_rec(r, in), r->type != R_END) {
+			char *newfile;
+
+			if (r->type == R_DIRERR) {
+				errno = r->err;
+				bb_perror_msg("can't open '%s'", filename);
+				G.status = EXIT_FAILURE;
+				failed = 1;
+				continue;
+			}
+			newfile = concat_path_file(filename, r->name);
+			++G.du_depth;
+			if (r->type == R_JOB) {
+				struct du_in *job_in = next_job();
+
+				get_rec(r, job_in);
+				sum += replay(newfile, r, job_in);
+			} else {
+				sum += replay(newfile, r, in);
+			}
+			--G.du_depth;
+			free(newfile);
+		}
+		if (failed)
+			return sum;
+	} else {
+		if (!(option_mask32 & OPT_a_files_too) && G.du_depth != 0)
+			return sum;
+	}
+	if (G.du_depth <= G.max_print_depth) {
+		print(sum, filename);
+	}
+	return sum;
+}
+
+/* Read past the contents of a directory we don't count */
+static void skip_dir(struct du_rec *r, struct du_in *in)
+{
+	for (;;) {
+		get_rec(r, in);
+		if (r->type == R_END)
+			break;
+		if (r->type == R_JOB) {
+			struct du_in *job_in = next_job();
+
+			get_rec(r, job_in);
+			if (r->type == R_ENTRY && r->is_dir)
+				skip_dir(r, job_in);
+		}
+		if (r->type == R_ENTRY && r->is_dir)
+			skip_dir(r, in);
+	}
+}
+
+static unsigned long long du_parallel(const char *filename)
+{
+	struct du_rec r;
+	struct du_in *in;
+	unsigned long long sum;
+	unsigned i;
+	FILE *fp;
+
+	/* Walk the top levels ourself, collecting jobs */
+	fp = xtmpfile();
+	G.out = fp;
+	du_walk(filename, "");
+	if (fflush(fp) != 0)
+		bb_perror_msg_and_die("can't write temporary file");
+	start_walkers();
+
+	in = xzalloc(sizeof(*in));
+	in->fd = fileno(fp);
+	get_rec(&r, in);
+	sum = replay(filename, &r, in);
+	free(in);
+	fclose(fp);
+
+	for (i = 0; i < G.walker_cnt; i++) {
+		struct du_walker *w = &G.walkers[i];
+		int status;
+
+		close(w->done_fd);
+		fclose(w->fp);
+		if (safe_waitpid(w->pid, &status, 0) < 0 || status != 0)
+			bb_error_msg_and_die("walker failed");
+	}
+	free(G.walkers);
+	G.walkers = NULL;
+	G.walker_cnt = 0;
+	G.job_cnt = G.job_replayed = 0;
+	return sum;
+}
+#endif
+
 int du_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
 int du_main(int argc UNUSED_PARAM, char **argv)
 {
 	unsigned long long total;
 	int slink_depth_save;
 	unsigned opt;
+	IF_FEATURE_DU_PARALLEL(int opt_j = 1;)
 
 	INIT_G();
 
@@ -216,8 +610,9 @@ int du_main(int argc UNUSED_PARAM, char **argv)
 	 * ignore -a.  This is consistent with -s being equivalent to -d 0.
 	 */
 #if ENABLE_FEATURE_HUMAN_READABLE
-	opt_complementary = "h-km:k-hm:m-hk:H-L:L-H:s-d:d-s:d+";
-	opt = getopt32(argv, "aHkLsx" "d:" "lc" "hm", &G.max_print_depth);
+	opt_complementary = "h-km:k-hm:m-hk:H-L:L-H:s-d:d-s:d+" IF_FEATURE_DU_PARALLEL(":j+");
+	opt = getopt32(argv, "aHkLsx" "d:" "lc" "hm" IF_FEATURE_DU_PARALLEL("j:"),
+			&G.max_print_depth IF_FEATURE_DU_PARALLEL(, &opt_j));
 	argv += optind;
 	if (opt & OPT_h_for_humans) {
 		G.disp_hr = 0;
@@ -229,8 +624,9 @@ int du_main(int argc UNUSED_PARAM, char **argv)
 		G.disp_hr = 1024;
 	}
 #else
-	opt_complementary = "H-L:L-H:s-d:d-s:d+";
-	opt = getopt32(argv, "aHkLsx" "d:" "lc", &G.max_print_depth);
+	opt_complementary = "H-L:L-H:s-d:d-s:d+" IF_FEATURE_DU_PARALLEL(":j+");
+	opt = getopt32(argv, "aHkLsx" "d:" "lc" IF_FEATURE_DU_PARALLEL("j:"),
+			&G.max_print_depth IF_FEATURE_DU_PARALLEL(, &opt_j));
 	argv += optind;
 #if !ENABLE_FEATURE_DU_DEFAULT_BLOCKSIZE_1K
 	if (opt & OPT_k_kbytes) {
@@ -256,9 +652,15 @@ int du_main(int argc UNUSED_PARAM, char **argv)
 		}
 	}
 
+	IF_FEATURE_DU_PARALLEL(G.job_max = opt_j;)
 	slink_depth_save = G.slink_depth;
 	total = 0;
 	do {
+#if ENABLE_FEATURE_DU_PARALLEL
+		if (G.job_max > 1)
+			total += du_parallel(*argv);
+		else
+#endif
 		total += du(*argv);
 		/* otherwise du /dir /dir won't show /dir twice: */
 		reset_ino_dev_hashtable();
@@ -25,18 +25,114 @@
 
 /* This is a NOEXEC applet. Be very careful! */
 
-struct lstring {
-	int size;
-	char buf[1];
-};
+enum { TAC_BLOCK = 64 * 1024 };
+
+/* Print lines which end in buf[off..off+len) in reverse order.
+ * If pos > start, data from start to pos (file offsets) precedes it:
+ * it is pread from fd in blocks, going backwards.
+ * Memory use is bounded by the longest line.
+ * Returns 0, or -1 if read fails.
+ */
+static int tac_buf(int fd, const char *name, char *buf, size_t cap,
+		size_t off, size_t len, off_t start, off_t pos)
+{
+	/* Bytes before end of data in which we still look for '\n':
+	 * the last byte is the end of the current line, not its start */
+	size_t todo = len ? len - 1 : 0;
+	int retval = 0;
+
+	while (1) {
+		char *nl;
+		ssize_t n;
+
+		while (todo && (nl = memrchr(buf + off, '\n', todo)) != NULL) {
+			size_t line = buf + off + len - (nl + 1);
+			fwrite(nl + 1, 1, line, stdout);
+			len -= line;
+			todo = len - 1;
+		}
+		if (pos == start)
+			break;
+		/* Need more data in front of what we have */
+		if (off < TAC_BLOCK) {
+			if (len + TAC_BLOCK > cap) {
+				/* Line longer than buffer */
+				cap = len * 2 + TAC_BLOCK;
+				buf = xrealloc(buf, cap);
+			}
+			memmove(buf + cap - len, buf + off, len);
+			off = cap - len;
+		}
+		n = off;
+		if (n > pos - start)
+			n = pos - start;
+		pos -= n;
+		off -= n;
+		errno = 0;
+		if (pread(fd, buf + off, n, pos) != n) {
+			/* File shrank under us? */
+			if (errno)
+				bb_simple_perror_msg(name);
+			else
+				bb_error_msg("%s: short read", name);
+			retval = -1;
+			break;
+		}
+		len += n;
+		/* Rest of data is already known to have no '\n' */
+		todo = n;
+	}
+	/* First line (or what we could read of it) */
+	fwrite(buf + off, 1, len, stdout);
+	free(buf);
+	return retval;
+}
+
+static int tac_fd(int fd, const char *name)
+{
+	struct stat st;
+	size_t size;
+	char *buf;
+
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+		/* Seekable: read it backwards, starting from the end.
+		 * (Files in /proc have zero st_size, we don't do this for them.
+		 * Files in /sys claim 4096 bytes but have fewer: if the last
+		 * block reads short, the size is made up, read it all instead) */
+		off_t start = lseek(fd, 0, SEEK_CUR);
+		off_t end = lseek(fd, 0, SEEK_END);
+		if (start >= 0 && end >= start) {
+			ssize_t n = TAC_BLOCK * 2;
+			ssize_t r;
+
+			if (n > end - start)
+				n = end - start;
+			buf = xmalloc(TAC_BLOCK * 2);
+			r = pread(fd, buf + TAC_BLOCK * 2 - n, n, end - n);
+			if (r == n)
+				return tac_buf(fd, name, buf, TAC_BLOCK * 2,
+						TAC_BLOCK * 2 - n, n, start, end - n);
+			free(buf);
+			if (r < 0) {
+				bb_simple_perror_msg(name);
+				return -1;
+			}
+		}
+		lseek(fd, start, SEEK_SET);
+	}
+	/* Pipes and such: we have to read it all */
+	size = (size_t)-1;
+	buf = xmalloc_read(fd, &size);
+	if (!buf) {
+		bb_simple_perror_msg(name);
+		return -1;
+	}
+	return tac_buf(fd, name, buf, size, 0, size, 0, 0);
+}
 
 int tac_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
 int tac_main(int argc UNUSED_PARAM, char **argv)
 {
-	char **name;
-	FILE *f;
-	struct lstring *line = NULL;
-	llist_t *list = NULL;
 	int retval = EXIT_SUCCESS;
 
 #if ENABLE_DESKTOP
@@ -56,56 +152,20 @@ We support none, but at least we will complain or handle "--":
 #endif
 	if (!*argv)
 		*--argv = (char *)"-";
-	/* We will read from last file to first */
-	name = argv;
-	while (*name)
-		name++;
 
+	/* Every file is reversed separately */
 	do {
-		int ch, i;
-
-		name--;
-		f = fopen_or_warn_stdin(*name);
-		if (f == NULL) {
-			/* error message is printed by fopen_or_warn_stdin */
+		int fd = open_or_warn_stdin(*argv);
+		if (fd < 0) {
+			/* error message is printed by open_or_warn_stdin */
 			retval = EXIT_FAILURE;
 			continue;
 		}
-
-		errno = i = 0;
-		do {
-			ch = fgetc(f);
-			if (ch != EOF) {
-				if (!(i & 0x7f))
-					/* Grow on every 128th char */
-					line = xrealloc(line, i + 0x7f + sizeof(int) + 1);
-				line->buf[i++] = ch;
-			}
-			if (ch == '\n' || (ch == EOF && i != 0)) {
-				line = xrealloc(line, i + sizeof(int));
-				line->size = i;
-				llist_add_to(&list, line);
-				line = NULL;
-				i = 0;
-			}
-		} while (ch != EOF);
-		/* fgetc sets errno to ENOENT on EOF, we don't want
-		 * to warn on this non-error! */
-		if (errno && errno != ENOENT) {
-			bb_simple_perror_msg(*name);
+		if (tac_fd(fd, *argv) < 0)
 			retval = EXIT_FAILURE;
-		}
-	} while (name != argv);
-
-	while (list) {
-		line = (struct lstring *)list->data;
-		xwrite(STDOUT_FILENO, line->buf, line->size);
-		if (ENABLE_FEATURE_CLEAN_UP) {
-			free(llist_pop(&list));
-		} else {
-			list = list->link;
-		}
-	}
+		if (fd != STDIN_FILENO)
+			close(fd);
+	} while (*++argv);
 
-	return retval;
+	fflush_stdout_and_exit(retval);
 }
@@ -50,10 +50,17 @@
 //usage:       "nameserver 10.0.0.1\n"
 
 #include "libbb.h"
+#if ENABLE_FEATURE_TAIL_INOTIFY
+# include <sys/inotify.h>
+# include <sys/vfs.h>
+#endif
 
 struct globals {
 	bool from_top;
 	bool exitcode;
+#if ENABLE_FEATURE_TAIL_INOTIFY
+	int inotify_fd; /* -1: check files every sleep_period */
+#endif
 } FIX_ALIASING;
 #define G (*(struct globals*)&bb_common_bufsiz1)
 #define INIT_G() do { } while (0)
@@ -79,6 +86,99 @@ static ssize_t tail_read(int fd, char *buf, size_t count)
 
 #define header_fmt_str "\n==> %s <==\n"
 
+#if ENABLE_FEATURE_TAIL_INOTIFY
+/* With -f, sleep until a followed file changes. With -F, also watch
+ * their directories: a rotated file reappears there.
+ * If anything can't be watched (stdin, no kernel support,
+ * out of watches, network filesystems), fall back to checking
+ * files every sleep_period.
+ */
+enum {
+	TAIL_FILE_EVENTS = IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF,
+	TAIL_DIR_EVENTS  = IN_CREATE | IN_MOVED_TO,
+};
+
+static void tail_stop_watching(void)
+{
+	if (G.inotify_fd >= 0) {
+		close(G.inotify_fd);
+		G.inotify_fd = -1;
+	}
+}
+
+/* inotify doesn't see changes made by other hosts */
+static int tail_remote_fs(const char *path)
+{
+	static const uint32_t remote_types[] = {
+		0x6969,     /* nfs */
+		0x517B,     /* smb */
+		0xFF534D42, /* cifs */
+		0xFE534D42, /* smb2 */
+		0x65735546, /* fuse */
+		0x01021997, /* 9p */
+		0x00C36400, /* ceph */
+		0x73757245, /* coda */
+		0x5346414F, /* afs */
+	};
+	struct statfs sfs;
+	unsigned i;
+
+	if (statfs(path, &sfs) != 0)
+		return 1;
+	for (i = 0; i < ARRAY_SIZE(remote_types); i++)
+		if ((uint32_t)sfs.f_type == remote_types[i])
+			return 1;
+	return 0;
+}
+
+static void tail_watch(const char *path, uint32_t mask)
+{
+	if (G.inotify_fd >= 0
+	 && (tail_remote_fs(path) || inotify_add_watch(G.inotify_fd, path, mask) < 0)
+	) {
+		tail_stop_watching();
+	}
+}
+
+static void tail_start_watching(char **argv, int *fds, int nfiles, int retry)
+{
+	int i;
+
+	G.inotify_fd = inotify_init();
+	for (i = 0; i < nfiles; i++) {
+		const char *filename = argv[i];
+
+		if (filename == bb_msg_standard_input || LONE_DASH(filename)) {
+			tail_stop_watching();
+			break;
+		}
+		if (retry) {
+			char *slash = strrchr(filename, '/');
+			char *dir = slash ? xstrndup(filename, slash - filename + 1) : (char*)".";
+			tail_watch(dir, TAIL_DIR_EVENTS);
+			if (slash)
+				free(dir);
+		}
+		if (fds[i] >= 0)
+			tail_watch(filename, TAIL_FILE_EVENTS);
+	}
+}
+#endif
+
+static void tail_wait(unsigned sleep_period)
+{
+#if ENABLE_FEATURE_TAIL_INOTIFY
+	if (G.inotify_fd >= 0) {
+		/* We don't care which file it was, we check them all */
+		char buf[sizeof(struct inotify_event) + NAME_MAX + 1];
+		if (safe_read(G.inotify_fd, buf, sizeof(buf)) > 0)
+			return;
+		tail_stop_watching();
+	}
+#endif
+	sleep(sleep_period);
+}
+
 static unsigned eat_num(const char *p)
 {
 	if (*p == '-')
@@ -167,6 +267,13 @@ int tail_main(int argc, char **argv)
 	if (!nfiles)
 		bb_error_msg_and_die("no files");
 
+#if ENABLE_FEATURE_TAIL_INOTIFY
+	/* Before reading: changes made meanwhile must wake us up */
+	G.inotify_fd = -1;
+	if (FOLLOW)
+		tail_start_watching(argv, fds, nfiles, FOLLOW_RETRY);
+#endif
+
 	/* prepare the buffer */
 	tailbufsize = BUFSIZ;
 	if (!G.from_top && COUNT_BYTES) {
@@ -317,7 +424,7 @@ int tail_main(int argc, char **argv)
 	fmt = NULL;
 
 	if (FOLLOW) while (1) {
-		sleep(sleep_period);
+		tail_wait(sleep_period);
 
 		i = 0;
 		do {
@@ -343,6 +450,7 @@ int tail_main(int argc, char **argv)
 						bb_error_msg("%s has %s; following end of new file",
 							filename, (fd < 0) ? "appeared" : "been replaced"
 						);
+						IF_FEATURE_TAIL_INOTIFY(tail_watch(filename, TAIL_FILE_EVENTS);)
 					} else if (fd >= 0) {
 						bb_perror_msg("%s has become inaccessible", filename);
 					}
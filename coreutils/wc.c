@@ -35,6 +35,11 @@
  *      (dd ibs=1k skip=1 count=0 &> /dev/null; wc -c) < /tmp/testfile
  *
  * for which 'wc -c' should output '0'.
+ *
+ * Now 'wc -c' does use the size of a regular file, the way GNU wc does:
+ * it seeks from the current position to near the end and reads only
+ * the rest. Reading the last block copes with /proc and /sys files,
+ * whose st_size can't be trusted.
  */
 #include "libbb.h"
 #include "unicode.h"
@@ -54,6 +59,8 @@
 # define COUNT_FMT "u"
 #endif
 
+#define WC_BUFSIZE (64 * 1024)
+
 /* We support -m even when UNICODE_SUPPORT is off,
  * we just don't advertise it in help text,
  * since it is the same as -c in this case.
@@ -88,12 +95,24 @@ enum {
 	NUM_WCS     = 5,
 };
 
+static unsigned count_newlines(const char *p, const char *end)
+{
+	unsigned n = 0;
+
+	while ((p = memchr(p, '\n', end - p)) != NULL) {
+		n++;
+		p++;
+	}
+	return n;
+}
+
 int wc_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
 int wc_main(int argc UNUSED_PARAM, char **argv)
 {
 	const char *arg;
 	const char *start_fmt = " %9"COUNT_FMT + 1;
 	const char *fname_fmt = " %s\n";
+	char *buf;
 	COUNT_T *pcounts;
 	COUNT_T counts[NUM_WCS];
 	COUNT_T totals[NUM_WCS];
@@ -122,18 +141,19 @@ int wc_main(int argc UNUSED_PARAM, char **argv)
 	memset(totals, 0, sizeof(totals));
 
 	pcounts = counts;
+	buf = xmalloc(WC_BUFSIZE);
 
 	num_files = 0;
 	while ((arg = *argv++) != NULL) {
-		FILE *fp;
 		const char *s;
 		unsigned u;
 		unsigned linepos;
 		smallint in_word;
+		int fd;
 
 		++num_files;
-		fp = fopen_or_warn_stdin(arg);
-		if (!fp) {
+		fd = open_or_warn_stdin(arg);
+		if (fd < 0) {
 			status = EXIT_FAILURE;
 			continue;
 		}
@@ -142,66 +162,97 @@ int wc_main(int argc UNUSED_PARAM, char **argv)
 		linepos = 0;
 		in_word = 0;
 
+		if (print_type == (1 << WC_BYTES)) {
+			struct stat st;
+
+			if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+				off_t pos = lseek(fd, 0, SEEK_CUR);
+				off_t hi = st.st_size - st.st_size % (st.st_blksize + 1);
+				if (pos >= 0 && pos < hi && lseek(fd, hi, SEEK_SET) == hi)
+					counts[WC_BYTES] = hi - pos;
+			}
+		}
+
 		while (1) {
-			int c;
-			/* Our -w doesn't match GNU wc exactly... oh well */
+			const char *p, *end;
+			ssize_t len;
 
-			c = getc(fp);
-			if (c == EOF) {
-				if (ferror(fp)) {
+			len = safe_read(fd, buf, WC_BUFSIZE);
+			if (len <= 0) {
+				if (len < 0) {
 					bb_simple_perror_msg(arg);
 					status = EXIT_FAILURE;
 				}
-				goto DO_EOF;  /* Treat an EOF as '\r'. */
+				break;
 			}
+			end = buf + len;
 
 			/* Cater for -c and -m */
-			++counts[WC_BYTES];
-			if (unicode_status != UNICODE_ON /* every byte is a new char */
-			 || (c & 0xc0) != 0x80 /* it isn't a 2nd+ byte of a Unicode char */
-			) {
-				++counts[WC_UNICHARS];
+			counts[WC_BYTES] += len;
+			if (unicode_status != UNICODE_ON) {
+				/* every byte is a new char */
+				counts[WC_UNICHARS] += len;
+			} else if (print_type & (1 << WC_UNICHARS)) {
+				for (p = buf; p < end; p++) {
+					/* it isn't a 2nd+ byte of a Unicode char? */
+					if ((*p & 0xc0) != 0x80)
+						++counts[WC_UNICHARS];
+				}
 			}
 
-			if (isprint_asciionly(c)) { /* FIXME: not unicode-aware */
-				++linepos;
-				if (!isspace(c)) {
-					in_word = 1;
-					continue;
-				}
-			} else if ((unsigned)(c - 9) <= 4) {
-				/* \t  9
-				 * \n 10
-				 * \v 11
-				 * \f 12
-				 * \r 13
-				 */
-				if (c == '\t') {
-					linepos = (linepos | 7) + 1;
-				} else {  /* '\n', '\r', '\f', or '\v' */
- DO_EOF:
-					if (linepos > counts[WC_LENGTH]) {
-						counts[WC_LENGTH] = linepos;
-					}
-					if (c == '\n') {
-						++counts[WC_LINES];
+			if (!(print_type & ((1 << WC_WORDS) | (1 << WC_LENGTH)))) {
+				/* Only -l is left, it needs no per-byte state */
+				if (print_type & (1 << WC_LINES))
+					counts[WC_LINES] += count_newlines(buf, end);
+				continue;
+			}
+
+			for (p = buf; p < end; p++) {
+				unsigned c = (unsigned char)*p;
+				/* Our -w doesn't match GNU wc exactly... oh well */
+
+				if (isprint_asciionly(c)) { /* FIXME: not unicode-aware */
+					++linepos;
+					if (!isspace(c)) {
+						in_word = 1;
+						continue;
 					}
-					if (c != '\v') {
-						linepos = 0;
+				} else if (c - 9 <= 4) {
+					/* \t  9
+					 * \n 10
+					 * \v 11
+					 * \f 12
+					 * \r 13
+					 */
+					if (c == '\t') {
+						linepos = (linepos | 7) + 1;
+					} else {  /* '\n', '\r', '\f', or '\v' */
+						if (linepos > counts[WC_LENGTH]) {
+							counts[WC_LENGTH] = linepos;
+						}
+						if (c == '\n') {
+							++counts[WC_LINES];
+						}
+						if (c != '\v') {
+							linepos = 0;
+						}
 					}
+				} else {
+					continue;
 				}
-			} else {
-				continue;
-			}
 
-			counts[WC_WORDS] += in_word;
-			in_word = 0;
-			if (c == EOF) {
-				break;
+				counts[WC_WORDS] += in_word;
+				in_word = 0;
 			}
 		}
+		/* Treat an EOF as '\r' */
+		if (linepos > counts[WC_LENGTH]) {
+			counts[WC_LENGTH] = linepos;
+		}
+		counts[WC_WORDS] += in_word;
 
-		fclose_if_not_stdin(fp);
+		if (fd != STDIN_FILENO)
+			close(fd);
 
 		if (totals[WC_LENGTH] < counts[WC_LENGTH]) {
 			totals[WC_LENGTH] = counts[WC_LENGTH];
@@ -236,5 +287,7 @@ int wc_main(int argc UNUSED_PARAM, char **argv)
 		goto OUTPUT;
 	}
 
+	if (ENABLE_FEATURE_CLEAN_UP)
+		free(buf);
 	fflush_stdout_and_exit(status);
 }
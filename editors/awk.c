@@ -32,6 +32,16 @@
 //config:	  * simultaneous use of -f and -e on the command line.
 //config:	    This enables the use of awk library files.
 //config:	    Ex: awk -f mylib.awk -e '{print myfunction($1);}' ...
+//config:
+//config:config FEATURE_AWK_COMPILE
+//config:	bool "Compile expressions to bytecode"
+//config:	default y
+//config:	depends on AWK
+//config:	help
+//config:	  Translate each expression to a flat list of register
+//config:	  instructions the first time it is evaluated, instead of
+//config:	  walking its parse tree recursively every time.
+//config:	  Speeds up CPU-bound scripts up to 3-4 times, costs about 4k.
 
 //applet:IF_AWK(APPLET_NOEXEC(awk, awk, BB_DIR_USR_BIN, BB_SUID_DROP, awk))
 
@@ -59,6 +69,8 @@
 #define debug_printf_walker(...)  do {} while (0)
 #define debug_printf_eval(...)  do {} while (0)
 #define debug_printf_parse(...)  do {} while (0)
+/* Count dynamic regex cache hits and misses, print them on exit */
+#define DEBUG_RE_CACHE 0
 
 #ifndef debug_printf_walker
 # define debug_printf_walker(...) (fprintf(stderr, __VA_ARGS__))
@@ -93,6 +105,7 @@ enum {
 
 #define	MAXVARFMT       240
 #define	MINNVBLOCK      64
+#define	AWK_READ_CHUNK  (64 * 1024)
 
 /* variable flags */
 #define	VF_NUMBER       0x0001	/* 1 = primary type is number */
@@ -158,16 +171,29 @@ typedef struct hash_item_s {
 		struct rstream_s rs;    /* redirect streams hash */
 		struct func_s f;        /* functions hash */
 	} data;
-	struct hash_item_s *next;       /* next in chain */
+	unsigned hval;                  /* hashidx(name) */
+	unsigned pos;                   /* index in xhash::items[] */
 	char name[1];                   /* really it's longer */
 } hash_item;
 
+/* Open addressing: slots are probed linearly, and a slot keeps the
+ * hash of its key, so that most mismatches are rejected without
+ * touching the item. Items are never moved (pointers to their data
+ * are kept everywhere) and are listed in items[] in insertion order,
+ * which is also the order of "for (k in array)" */
+typedef struct hash_slot_s {
+	unsigned hval;
+	struct hash_item_s *hi; /* NULL: free */
+} hash_slot;
+#define HASH_REMOVED ((hash_item *)(ptrdiff_t)-1)  /* hash_slot::hi */
+
 typedef struct xhash_s {
 	unsigned nel;           /* num of elements */
-	unsigned csize;         /* current hash size */
-	unsigned nprime;        /* next hash size in PRIMES[] */
+	unsigned nitems;        /* used part of items[], holes included */
 	unsigned glen;          /* summary length of item names */
-	struct hash_item_s **items;
+	uint8_t bits;           /* log2 of number of slots */
+	struct hash_item_s **items;  /* NULL if removed */
+	hash_slot *slots;
 } xhash;
 
 /* Tree node */
@@ -189,8 +215,33 @@ typedef struct node_s {
 	union {
 		struct node_s *n;
 	} a;
+	IF_FEATURE_AWK_COMPILE(struct bcprog_s *bc;)
 } node;
 
+#if ENABLE_FEATURE_AWK_COMPILE
+/* Compiled expression: registers hold var pointers. Registers of
+ * constants and plain variables are bound at compile time, each of the
+ * others is written by one instruction (both arms of ?: share one) */
+typedef struct bcinsn_s {
+	uint8_t op;
+	uint8_t opn;		/* operator, as in node::info */
+	uint16_t d, a, b;	/* result and operand registers */
+	unsigned lineno;
+	union {
+		node *n;	/* BC_MATCH, BC_REGEXP, BC_CALL */
+		int aidx;	/* BC_FNARG */
+		unsigned jmp;	/* BC_JFALSE, BC_JMP, BC_LAND, BC_LOR */
+	} x;
+} bcinsn;
+
+typedef struct bcprog_s {
+	bcinsn *insn;
+	var **reg;
+	var *tmp;		/* values of unbound registers */
+	smallint busy;		/* running: recursive calls walk the tree */
+} bcprog;
+#endif
+
 /* Block of temporary variables */
 typedef struct nvblock_s {
 	int size;
@@ -205,6 +256,15 @@ typedef struct tsplitter_s {
 	regex_t re[2];
 } tsplitter;
 
+/* Compiled dynamic regex ("$0 ~ var", split(s, a, var) etc) */
+typedef struct re_cache_ent {
+	char *pattern;          /* NULL if the slot is unused */
+	unsigned last_used;     /* for LRU eviction */
+	smallint is_icase;
+	regex_t re;
+} re_cache_ent;
+#define RE_CACHE_SIZE 16
+
 /* simple token classes */
 /* Order and hex values are very important!!!  See next_token() */
 #define	TC_SEQSTART	1			/* ( */
@@ -462,8 +522,7 @@ static const char vValues[] ALIGN1 =
 	"\034\0"    "\0"        "\377";
 
 /* hash size may grow to these values */
-#define FIRST_PRIME 61
-static const uint16_t PRIMES[] ALIGN2 = { 251, 1021, 4093, 16381, 65521 };
+#define FIRST_HASH_BITS 6
 
 
 /* Globals. Split in two parts so that first one is addressed
@@ -482,7 +541,9 @@ struct globals {
 	int g_lineno;
 	int nfields;
 	int maxfields; /* used in fsrealloc() only */
+	int nfields_set; /* Fields[nfields_set..nfields-1] are not set yet */
 	var *Fields;
+	char *next_fstring; /* value for Fields[nfields_set] */
 	nvblock *g_cb;
 	char *g_pos;
 	char *g_buf;
@@ -503,6 +564,7 @@ struct globals2 {
 
 	/* former statics from various functions */
 	char *split_f0__fstrings;
+	int split_f0__fstrings_size;
 
 	uint32_t next_token__save_tclass;
 	uint32_t next_token__save_info;
@@ -514,14 +576,22 @@ struct globals2 {
 
 	var *evaluate__fnargs;
 	unsigned evaluate__seed;
-	regex_t evaluate__sreg;
 
 	var ptest__v;
 
-	tsplitter exec_builtin__tspl;
+#if ENABLE_FEATURE_AWK_COMPILE
+	bcprog bc_none;		/* for nodes which are not compiled */
+#endif
+
+	unsigned re_cache_clock;
+#if DEBUG_RE_CACHE
+	unsigned re_cache_hits;
+	unsigned re_cache_misses;
+#endif
 
 	/* biggest and least used members go last */
 	tsplitter fsplitter, rsplitter;
+	re_cache_ent re_cache[RE_CACHE_SIZE];
 };
 #define G1 (ptr_to_globals[-1])
 #define G (*(struct globals2 *)ptr_to_globals)
@@ -545,6 +615,8 @@ struct globals2 {
 #define g_progname   (G1.g_progname  )
 #define g_lineno     (G1.g_lineno    )
 #define nfields      (G1.nfields     )
+#define nfields_set  (G1.nfields_set )
+#define next_fstring (G1.next_fstring)
 #define maxfields    (G1.maxfields   )
 #define Fields       (G1.Fields      )
 #define g_cb         (G1.g_cb        )
@@ -567,6 +639,7 @@ struct globals2 {
 	SET_PTR_TO_GLOBALS((char*)xzalloc(sizeof(G1)+sizeof(G)) + sizeof(G1)); \
 	G.next_token__ltclass = TC_OPTERM; \
 	G.evaluate__seed = 1; \
+	IF_FEATURE_AWK_COMPILE(G.bc_none.busy = 1;) \
 } while (0)
 
 
@@ -620,75 +693,114 @@ static xhash *hash_init(void)
 	xhash *newhash;
 
 	newhash = xzalloc(sizeof(*newhash));
-	newhash->csize = FIRST_PRIME;
-	newhash->items = xzalloc(FIRST_PRIME * sizeof(newhash->items[0]));
+	newhash->bits = FIRST_HASH_BITS;
+	newhash->slots = xzalloc(sizeof(newhash->slots[0]) << FIRST_HASH_BITS);
+	newhash->items = xmalloc(sizeof(newhash->items[0]) << FIRST_HASH_BITS);
 
 	return newhash;
 }
 
+static void hash_free(xhash *hash)
+{
+	free(hash->slots);
+	free(hash->items);
+	free(hash);
+}
+
+/* first slot to probe for hash value h */
+#define hash_first(hash, h) (((h) * 0x9e3779b1) >> (32 - (hash)->bits))
+
+/* find the slot of name, or the free slot which ends its probe sequence */
+static hash_slot *hash_lookup(xhash *hash, const char *name, unsigned h)
+{
+	unsigned mask = (1 << hash->bits) - 1;
+	unsigned i = hash_first(hash, h);
+	hash_slot *sl;
+
+	for (;;) {
+		sl = &hash->slots[i];
+		if (!sl->hi)
+			return sl;
+		if (sl->hval == h && sl->hi != HASH_REMOVED
+		 && strcmp(sl->hi->name, name) == 0
+		) {
+			return sl;
+		}
+		i = (i + 1) & mask;
+	}
+}
+
 /* find item in hash, return ptr to data, NULL if not found */
 static void *hash_search(xhash *hash, const char *name)
 {
-	hash_item *hi;
+	hash_slot *sl;
 
-	hi = hash->items[hashidx(name) % hash->csize];
-	while (hi) {
-		if (strcmp(hi->name, name) == 0)
-			return &hi->data;
-		hi = hi->next;
-	}
-	return NULL;
+	sl = hash_lookup(hash, name, hashidx(name));
+	if (!sl->hi)
+		return NULL;
+	return &sl->hi->data;
 }
 
-/* grow hash if it becomes too big */
+/* squeeze out removed items, grow the table if it is half full */
 static void hash_rebuild(xhash *hash)
 {
-	unsigned newsize, i, idx;
-	hash_item **newitems, *hi, *thi;
-
-	if (hash->nprime == ARRAY_SIZE(PRIMES))
-		return;
+	unsigned i, n, mask;
+	hash_item *hi;
+	hash_slot *sl;
 
-	newsize = PRIMES[hash->nprime++];
-	newitems = xzalloc(newsize * sizeof(newitems[0]));
+	if (hash->nel >= (1U << (hash->bits - 1)))
+		hash->bits++;
+	mask = (1 << hash->bits) - 1;
+	free(hash->slots);
+	hash->slots = xzalloc(sizeof(hash->slots[0]) << hash->bits);
+	hash->items = xrealloc(hash->items, sizeof(hash->items[0]) << hash->bits);
 
-	for (i = 0; i < hash->csize; i++) {
+	n = 0;
+	for (i = 0; i < hash->nitems; i++) {
 		hi = hash->items[i];
-		while (hi) {
-			thi = hi;
-			hi = thi->next;
-			idx = hashidx(thi->name) % newsize;
-			thi->next = newitems[idx];
-			newitems[idx] = thi;
-		}
+		if (!hi)
+			continue;
+		hi->pos = n;
+		hash->items[n++] = hi;
+		sl = &hash->slots[hash_first(hash, hi->hval)];
+		while (sl->hi)
+			sl = &hash->slots[(sl - hash->slots + 1) & mask];
+		sl->hval = hi->hval;
+		sl->hi = hi;
 	}
-
-	free(hash->items);
-	hash->csize = newsize;
-	hash->items = newitems;
+	hash->nitems = n;
 }
 
 /* find item in hash, add it if necessary. Return ptr to data */
 static void *hash_find(xhash *hash, const char *name)
 {
 	hash_item *hi;
-	unsigned idx;
+	hash_slot *sl;
+	unsigned h;
 	int l;
 
-	hi = hash_search(hash, name);
-	if (!hi) {
-		if (++hash->nel / hash->csize > 10)
-			hash_rebuild(hash);
-
-		l = strlen(name) + 1;
-		hi = xzalloc(sizeof(*hi) + l);
-		strcpy(hi->name, name);
+	h = hashidx(name);
+	sl = hash_lookup(hash, name, h);
+	if (sl->hi)
+		return &sl->hi->data;
 
-		idx = hashidx(name) % hash->csize;
-		hi->next = hash->items[idx];
-		hash->items[idx] = hi;
-		hash->glen += l;
+	/* keep at least a quarter of slots free, counting removed ones */
+	if (hash->nitems >= (3U << hash->bits) / 4) {
+		hash_rebuild(hash);
+		sl = hash_lookup(hash, name, h);
 	}
+
+	l = strlen(name) + 1;
+	hi = xzalloc(sizeof(*hi) + l);
+	hi->hval = h;
+	hi->pos = hash->nitems;
+	strcpy(hi->name, name);
+
+	hash->items[hash->nitems++] = hi;
+	sl->hval = h;
+	sl->hi = hi;
+	hash->nel++;
+	hash->glen += l;
 	return &hi->data;
 }
 
@@ -699,19 +811,15 @@ static void *hash_find(xhash *hash, const char *name)
 
 static void hash_remove(xhash *hash, const char *name)
 {
-	hash_item *hi, **phi;
+	hash_slot *sl;
 
-	phi = &hash->items[hashidx(name) % hash->csize];
-	while (*phi) {
-		hi = *phi;
-		if (strcmp(hi->name, name) == 0) {
-			hash->glen -= (strlen(name) + 1);
-			hash->nel--;
-			*phi = hi->next;
-			free(hi);
-			break;
-		}
-		phi = &hi->next;
+	sl = hash_lookup(hash, name, hashidx(name));
+	if (sl->hi) {
+		hash->glen -= (strlen(name) + 1);
+		hash->nel--;
+		hash->items[sl->hi->pos] = NULL;
+		free(sl->hi);
+		sl->hi = HASH_REMOVED;
 	}
 }
 
@@ -816,19 +924,17 @@ static xhash *iamarray(var *v)
 static void clear_array(xhash *array)
 {
 	unsigned i;
-	hash_item *hi, *thi;
+	hash_item *hi;
 
-	for (i = 0; i < array->csize; i++) {
+	for (i = 0; i < array->nitems; i++) {
 		hi = array->items[i];
-		while (hi) {
-			thi = hi;
-			hi = hi->next;
-			free(thi->data.v.string);
-			free(thi);
+		if (hi) {
+			free(hi->data.v.string);
+			free(hi);
 		}
-		array->items[i] = NULL;
 	}
-	array->glen = array->nel = 0;
+	memset(array->slots, 0, sizeof(array->slots[0]) << array->bits);
+	array->glen = array->nel = array->nitems = 0;
 }
 
 /* clear a variable */
@@ -1016,8 +1122,7 @@ static void nvfree(var *v)
 	for (p = v; p < g_cb->pos; p++) {
 		if ((p->type & (VF_ARRAY | VF_CHILD)) == VF_ARRAY) {
 			clear_array(iamarray(p));
-			free(p->x.array->items);
-			free(p->x.array);
+			hash_free(p->x.array);
 		}
 		if (p->type & VF_WALK) {
 			walker_list *n;
@@ -1650,21 +1755,39 @@ static node *mk_splitter(const char *s, tsplitter *spl)
 	return n;
 }
 
-/* use node as a regular expression. Supplied with node ptr and regex_t
- * storage space. Return ptr to regex (if result points to preg, it should
- * be later regfree'd manually
+/* Compile string as a regular expression. Programs usually match
+ * against a handful of patterns held in variables, so keep
+ * the last RE_CACHE_SIZE compiled ones.
+ * Returned regex is valid until the next call.
  */
-static regex_t *as_regex(node *op, regex_t *preg)
+static regex_t *get_regex(const char *s)
 {
+	re_cache_ent *ent, *lru;
 	int cflags;
-	var *v;
-	const char *s;
 
-	if ((op->info & OPCLSMASK) == OC_REGEXP) {
-		return icase ? op->r.ire : op->l.re;
+	lru = ent = G.re_cache;
+	for (; ent < G.re_cache + RE_CACHE_SIZE; ent++) {
+		if (!ent->pattern) {
+			lru = ent;
+			break;
+		}
+		if (ent->is_icase == icase && strcmp(ent->pattern, s) == 0) {
+			ent->last_used = ++G.re_cache_clock;
+#if DEBUG_RE_CACHE
+			G.re_cache_hits++;
+#endif
+			return &ent->re;
+		}
+		if (ent->last_used < lru->last_used)
+			lru = ent;
+	}
+#if DEBUG_RE_CACHE
+	G.re_cache_misses++;
+#endif
+	if (lru->pattern) {
+		free(lru->pattern);
+		regfree(&lru->re);
 	}
-	v = nvalloc(1);
-	s = getvar_s(evaluate(op, v));
 
 	cflags = icase ? REG_EXTENDED | REG_ICASE : REG_EXTENDED;
 	/* Testcase where REG_EXTENDED fails (unpaired '{'):
@@ -1672,12 +1795,31 @@ static regex_t *as_regex(node *op, regex_t *preg)
 	 * gawk 3.1.5 eats this. We revert to ~REG_EXTENDED
 	 * (maybe gsub is not supposed to use REG_EXTENDED?).
 	 */
-	if (regcomp(preg, s, cflags)) {
+	if (regcomp(&lru->re, s, cflags)) {
 		cflags &= ~REG_EXTENDED;
-		xregcomp(preg, s, cflags);
+		xregcomp(&lru->re, s, cflags);
+	}
+	lru->pattern = xstrdup(s);
+	lru->is_icase = icase;
+	lru->last_used = ++G.re_cache_clock;
+	return &lru->re;
+}
+
+/* use node as a regular expression. Return ptr to regex,
+ * it is valid until the next as_regex() call.
+ */
+static regex_t *as_regex(node *op)
+{
+	regex_t *re;
+	var *v;
+
+	if ((op->info & OPCLSMASK) == OC_REGEXP) {
+		return icase ? op->r.ire : op->l.re;
 	}
+	v = nvalloc(1);
+	re = get_regex(getvar_s(evaluate(op, v)));
 	nvfree(v);
-	return preg;
+	return re;
 }
 
 /* gradually increasing buffer.
@@ -1693,11 +1835,32 @@ static char* qrealloc(char *b, int n, int *size)
 	return b;
 }
 
+/* split_f0() only splits $0 into NUL-terminated words.
+ * Field variables get their values when they are used:
+ * "{ print $3, $7 }" does not need to set up all 50 fields.
+ * Make sure fields up to n are set.
+ */
+static void set_fields(int n)
+{
+	if (n > nfields)
+		n = nfields;
+	while (nfields_set < n) {
+		var *v = &Fields[nfields_set++];
+		v->string = nextword(&next_fstring);
+		v->type |= (VF_FSTR | VF_USER | VF_DIRTY);
+	}
+}
+
 /* resize field storage space */
 static void fsrealloc(int size)
 {
 	int i;
 
+	if (size > nfields) {
+		/* fields which are not set yet would be shadowed by new ones */
+		set_fields(nfields);
+		nfields_set = size;
+	}
 	if (size >= maxfields) {
 		i = maxfields;
 		maxfields = size + 16;
@@ -1707,23 +1870,30 @@ static void fsrealloc(int size)
 			Fields[i].string = NULL;
 		}
 	}
-	/* if size < nfields, clear extra field variables */
-	for (i = size; i < nfields; i++) {
+	/* if size < nfields, clear extra field variables
+	 * (the ones which are not set yet are clear already) */
+	for (i = size; i < nfields_set; i++) {
 		clrvar(Fields + i);
 	}
+	if (nfields_set > size)
+		nfields_set = size;
 	nfields = size;
 }
 
-static int awk_split(const char *s, node *spl, char **slist)
+/* Split s into NUL-terminated words in *slist buffer
+ * (reallocated as needed), return their count */
+static int awk_split(const char *s, node *spl, char **slist, int *slist_size)
 {
 	int l, n;
 	char c[4];
 	char *s1;
+	size_t len;
 	regmatch_t pmatch[2]; // TODO: why [2]? [1] is enough...
 
 	/* in worst case, each char would be a separate field */
-	*slist = s1 = xzalloc(strlen(s) * 2 + 3);
-	strcpy(s1, s);
+	len = strlen(s);
+	*slist = s1 = qrealloc(*slist, len * 2 + 3, slist_size);
+	memcpy(s1, s, len + 1);
 
 	c[0] = c[1] = (char)spl->info;
 	c[2] = c[3] = '\0';
@@ -1776,6 +1946,15 @@ static int awk_split(const char *s, node *spl, char **slist)
 		}
 		if (*s1)
 			n++;
+		if (c[0] == c[1] && c[2] == '\0') {
+			/* one separator char (the usual case) */
+			char *end = s1 + len;
+			while ((s1 = memchr(s1, c[0], end - s1)) != NULL) {
+				*s1++ = '\0';
+				n++;
+			}
+			return n;
+		}
 		while ((s1 = strpbrk(s1, c)) != NULL) {
 			*s1++ = '\0';
 			n++;
@@ -1800,22 +1979,18 @@ static void split_f0(void)
 /* static char *fstrings; */
 #define fstrings (G.split_f0__fstrings)
 
-	int i, n;
-	char *s;
+	int n;
 
 	if (is_f0_split)
 		return;
 
 	is_f0_split = TRUE;
-	free(fstrings);
 	fsrealloc(0);
-	n = awk_split(getvar_s(intvar[F0]), &fsplitter.n, &fstrings);
+	n = awk_split(getvar_s(intvar[F0]), &fsplitter.n, &fstrings, &G.split_f0__fstrings_size);
 	fsrealloc(n);
-	s = fstrings;
-	for (i = 0; i < n; i++) {
-		Fields[i].string = nextword(&s);
-		Fields[i].type |= (VF_FSTR | VF_USER | VF_DIRTY);
-	}
+	/* Fields[] are set by set_fields() on demand */
+	nfields_set = 0;
+	next_fstring = fstrings;
 
 	/* set NF manually to avoid side effects */
 	clrvar(intvar[NF]);
@@ -1838,6 +2013,7 @@ static void handle_special(var *v)
 	if (v == intvar[NF]) {
 		n = (int)getvar_i(v);
 		fsrealloc(n);
+		set_fields(n);
 
 		/* recalculate $0 */
 		sep = getvar_s(intvar[OFS]);
@@ -1925,12 +2101,11 @@ static void hashwalk_init(var *v, xhash *array)
 	debug_printf_walker(" walker@%p=%p\n", &v->x.walker, w);
 	w->cur = w->end = w->wbuf;
 	w->prev = prev_walker;
-	for (i = 0; i < array->csize; i++) {
+	for (i = 0; i < array->nitems; i++) {
 		hi = array->items[i];
-		while (hi) {
+		if (hi) {
 			strcpy(w->end, hi->name);
 			nextword(&w->end);
-			hi = hi->next;
 		}
 	}
 }
@@ -1959,6 +2134,27 @@ static int ptest(node *pattern)
 	return istrue(evaluate(pattern, &G.ptest__v));
 }
 
+/* awk_getline() can leave $0 pointing into the input buffer of rsm.
+ * Give $0 its own copy before that buffer is changed or freed */
+static void detach_f0(rstream *rsm)
+{
+	var *v = intvar[F0];
+
+	if ((v->type & VF_FSTR) && rsm->buffer
+	 && v->string >= rsm->buffer && v->string < rsm->buffer + rsm->size
+	) {
+		v->string = xstrdup(v->string);
+		v->type &= ~VF_FSTR;
+	}
+}
+
+/* set RT, unless it already has this value */
+static void set_rt(const char *s)
+{
+	if (strcmp(getvar_s(intvar[RT]), s) != 0)
+		setvar_s(intvar[RT], s);
+}
+
 /* read next record from stream rsm into a variable v */
 static int awk_getline(rstream *rsm, var *v)
 {
@@ -1981,9 +2177,6 @@ static int awk_getline(rstream *rsm, var *v)
 	c = (char) rsplitter.n.info;
 	rp = 0;
 
-	if (!m)
-		m = qrealloc(m, 256, &size);
-
 	do {
 		b = m + a;
 		so = eo = p;
@@ -1998,6 +2191,7 @@ static int awk_getline(rstream *rsm, var *v)
 						break;
 				}
 			} else if (c != '\0') {
+				/* NUL ends a record too */
 				s = strchr(b+pp, c);
 				if (!s)
 					s = memchr(b+pp, '\0', p - pp);
@@ -2020,14 +2214,18 @@ static int awk_getline(rstream *rsm, var *v)
 			}
 		}
 
+		if (m)
+			detach_f0(rsm);
 		if (a > 0) {
 			memmove(m, m+a, p+1);
 			b = m;
 			a = 0;
 		}
 
-		m = qrealloc(m, a+p+128, &size);
-		b = m + a;
+		m = qrealloc(m, p + AWK_READ_CHUNK, &size);
+		rsm->buffer = m;
+		rsm->size = size;
+		b = m;
 		pp = p;
 		p += safe_read(fd, b+p, size-p-1);
 		if (p < pp) {
@@ -2041,13 +2239,26 @@ static int awk_getline(rstream *rsm, var *v)
 
 	if (p == 0) {
 		r--;
+	} else if (v == intvar[F0] && (eo - so == 1 || b[so] == '\0')) {
+		/* one char RS (or none at EOF): hand out the record
+		 * in place, see detach_f0() */
+		char rt[2];
+
+		rt[0] = b[so];
+		rt[1] = '\0';
+		b[so] = '\0';
+		clrvar(v);
+		v->string = b + rp;
+		v->type |= VF_FSTR | VF_USER;
+		handle_special(v);
+		set_rt(rt);
 	} else {
 		c = b[so]; b[so] = '\0';
 		setvar_s(v, b+rp);
 		v->type |= VF_USER;
 		b[so] = c;
 		c = b[eo]; b[eo] = '\0';
-		setvar_s(intvar[RT], b+so);
+		set_rt(b+so);
 		b[eo] = c;
 	}
 
@@ -2154,13 +2365,13 @@ static int awk_sub(node *rn, const char *repl, int nm, var *src, var *dest, int
 	int match_no, residx, replen, resbufsize;
 	int regexec_flags;
 	regmatch_t pmatch[10];
-	regex_t sreg, *regex;
+	regex_t *regex;
 
 	resbuf = NULL;
 	residx = 0;
 	match_no = 0;
 	regexec_flags = 0;
-	regex = as_regex(rn, &sreg);
+	regex = as_regex(rn);
 	sp = getvar_s(src ? src : intvar[F0]);
 	replen = strlen(repl);
 	while (regexec(regex, sp, 10, pmatch, regexec_flags) == 0) {
@@ -2233,8 +2444,6 @@ static int awk_sub(node *rn, const char *repl, int nm, var *src, var *dest, int
  ret:
 	//bb_error_msg("end sp:'%s'%p", sp,sp);
 	setvar_p(dest ? dest : intvar[F0], resbuf);
-	if (regex == &sreg)
-		regfree(regex);
 	return match_no;
 }
 
@@ -2268,15 +2477,14 @@ static NOINLINE int do_mktime(const char *ds)
 
 static NOINLINE var *exec_builtin(node *op, var *res)
 {
-#define tspl (G.exec_builtin__tspl)
-
 	var *tv;
 	node *an[4];
 	var *av[4];
 	const char *as[4];
 	regmatch_t pmatch[2];
-	regex_t sreg, *re;
+	regex_t *re;
 	node *spl;
+	node tspl;
 	uint32_t isr, info;
 	int nargs;
 	time_t tt;
@@ -2312,15 +2520,28 @@ static NOINLINE var *exec_builtin(node *op, var *res)
 
 	case B_sp: {
 		char *s, *s1;
+		int ssize = 0;
 
 		if (nargs > 2) {
-			spl = (an[2]->info & OPCLSMASK) == OC_REGEXP ?
-				an[2] : mk_splitter(getvar_s(evaluate(an[2], &tv[2])), &tspl);
+			spl = an[2];
+			if ((spl->info & OPCLSMASK) != OC_REGEXP) {
+				const char *sep = getvar_s(evaluate(spl, &tv[2]));
+				/* Same as mk_splitter() would do,
+				 * but with a cached regex */
+				spl = &tspl;
+				if (sep[0] && sep[1]) {
+					tspl.info = OC_REGEXP;
+					tspl.l.re = tspl.r.ire = get_regex(sep);
+				} else {
+					tspl.info = (uint32_t) sep[0];
+				}
+			}
 		} else {
 			spl = &fsplitter.n;
 		}
 
-		n = awk_split(as[0], spl, &s);
+		s = NULL;
+		n = awk_split(as[0], spl, &s, &ssize);
 		s1 = s;
 		clear_array(iamarray(av[1]));
 		for (i = 1; i <= n; i++)
@@ -2429,7 +2650,7 @@ static NOINLINE var *exec_builtin(node *op, var *res)
 		break;
 
 	case B_ma:
-		re = as_regex(an[1], &sreg);
+		re = as_regex(an[1]);
 		n = regexec(re, as[0], 1, pmatch, 0);
 		if (n == 0) {
 			pmatch[0].rm_so++;
@@ -2441,8 +2662,6 @@ static NOINLINE var *exec_builtin(node *op, var *res)
 		setvar_i(newvar("RSTART"), pmatch[0].rm_so);
 		setvar_i(newvar("RLENGTH"), pmatch[0].rm_eo - pmatch[0].rm_so);
 		setvar_i(res, pmatch[0].rm_so);
-		if (re == &sreg)
-			regfree(re);
 		break;
 
 	case B_ge:
@@ -2460,28 +2679,483 @@ static NOINLINE var *exec_builtin(node *op, var *res)
 
 	nvfree(tv);
 	return res;
-#undef tspl
 }
 
+#define XC(n) ((n) >> 8)
+
+/* arithmetic of OC_BINARY and OC_REPLACE */
+static double arith_op(int opn, double L_d, double R_d)
+{
+	switch (opn) {
+	case '+':
+		L_d += R_d;
+		break;
+	case '-':
+		L_d -= R_d;
+		break;
+	case '*':
+		L_d *= R_d;
+		break;
+	case '/':
+		if (R_d == 0)
+			syntax_error(EMSG_DIV_BY_ZERO);
+		L_d /= R_d;
+		break;
+	case '&':
+		if (ENABLE_FEATURE_AWK_LIBM)
+			L_d = pow(L_d, R_d);
+		else
+			syntax_error(EMSG_NO_MATH);
+		break;
+	case '%':
+		if (R_d == 0)
+			syntax_error(EMSG_DIV_BY_ZERO);
+		L_d -= (long long)(L_d / R_d) * R_d;
+		break;
+	}
+	return L_d;
+}
+
+/* OC_COMPARE: return 1 if "l opn r" is true */
+static int compare_op(int opn, var *l, var *r)
+{
+	int i = 0;
+	double Ld;
+
+	if (is_numeric(l) && is_numeric(r)) {
+		Ld = getvar_i(l) - getvar_i(r);
+	} else {
+		const char *ls = getvar_s(l);
+		const char *rs = getvar_s(r);
+		Ld = icase ? strcasecmp(ls, rs) : strcmp(ls, rs);
+	}
+	switch (opn & 0xfe) {
+	case 0:
+		i = (Ld > 0);
+		break;
+	case 2:
+		i = (Ld >= 0);
+		break;
+	case 4:
+		i = (Ld == 0);
+		break;
+	}
+	return (i == 0) ^ (opn & 1);
+}
+
+/* OC_UNARY: apply opn to r, return value of the expression */
+static double unary_op(int opn, var *r)
+{
+	double Ld, R_d;
+
+	Ld = R_d = getvar_i(r);
+	switch (opn) {
+	case 'P':
+		Ld = ++R_d;
+		goto r_op_change;
+	case 'p':
+		R_d++;
+		goto r_op_change;
+	case 'M':
+		Ld = --R_d;
+		goto r_op_change;
+	case 'm':
+		R_d--;
+ r_op_change:
+		setvar_i(r, R_d);
+		break;
+	case '!':
+		Ld = !istrue(r);
+		break;
+	case '-':
+		Ld = -R_d;
+		break;
+	}
+	return Ld;
+}
+
+#if ENABLE_FEATURE_AWK_COMPILE
+/*
+ * Expression compiler. Only expressions are compiled: statements are
+ * already walked iteratively by evaluate(). An expression is compiled
+ * the first time it is evaluated; node types without an instruction
+ * of their own (function calls, builtins, getline...) become BC_CALL,
+ * which hands the subtree back to evaluate().
+ */
+enum {
+	BC_END,		/* return reg[0] */
+	BC_REF,		/* d = a */
+	BC_NF,		/* d = NF */
+	BC_FNARG,	/* d = function argument */
+	BC_ELEM,	/* d = a[b] */
+	BC_FIELD,	/* d = $a */
+	BC_BINARY,	/* d = a opn b */
+	BC_REPLACE,	/* d = a opn= b */
+	BC_MOVE,	/* d = a = b */
+	BC_COMPARE,	/* d = a opn b */
+	BC_UNARY,	/* d = opn a */
+	BC_CONCAT,	/* d = a b, or a SUBSEP b if opn is ',' */
+	BC_MATCH,	/* d = a ~ x.n */
+	BC_REGEXP,	/* d = $0 ~ x.n */
+	BC_IN,		/* d = a in b */
+	BC_JFALSE,	/* if (!a) jump */
+	BC_JMP,
+	BC_LAND,	/* if (!a) d = 0, jump */
+	BC_LOR,		/* if (a) d = 1, jump */
+	BC_BOOL,	/* d = !!a */
+	BC_CALL,	/* d = evaluate(x.n) */
+};
+
+/* Longer expressions are left to evaluate() */
+#define BC_MAXREG 1024
+
+typedef struct bcbuild_s {
+	bcinsn *insn;
+	var **reg;
+	unsigned ninsn;
+	unsigned nreg;
+} bcbuild;
+
+static int bc_reg(bcbuild *b, var *bound)
+{
+	if ((b->nreg & 15) == 0)
+		b->reg = xrealloc(b->reg, (b->nreg + 16) * sizeof(b->reg[0]));
+	b->reg[b->nreg] = bound;
+	return b->nreg++;
+}
+
+static bcinsn *bc_emit(bcbuild *b, int op, node *n, int d)
+{
+	bcinsn *ip;
+
+	if ((b->ninsn & 15) == 0)
+		b->insn = xrealloc(b->insn, (b->ninsn + 16) * sizeof(b->insn[0]));
+	ip = &b->insn[b->ninsn++];
+	memset(ip, 0, sizeof(*ip));
+	ip->op = op;
+	ip->d = (d < 0) ? bc_reg(b, NULL) : d;
+	if (n) {
+		ip->opn = n->info & OPNMASK;
+		ip->lineno = n->lineno;
+	}
+	return ip;
+}
+
+/* Compile n into register d (a new one if d < 0), return the register */
+static int bc_expr(bcbuild *b, node *n, int d)
+{
+	bcinsn *ip;
+	int a, r;
+	unsigned j;
+
+	if (b->nreg >= BC_MAXREG) /* too big, bc_compile() gives up */
+		return 0;
+
+	switch (n ? n->info & OPCLSMASK : 0) {
+	case OC_VAR:
+	case OC_FNARG:
+		r = 0;
+		if (n->r.n)
+			r = bc_expr(b, n->r.n, -1);
+		if ((n->info & OPCLSMASK) == OC_FNARG) {
+			ip = bc_emit(b, BC_FNARG, NULL, n->r.n ? -1 : d);
+			ip->x.aidx = n->l.aidx;
+			a = ip->d;
+		} else if (n->l.v == intvar[NF]) {
+			a = bc_emit(b, BC_NF, NULL, n->r.n ? -1 : d)->d;
+		} else {
+			a = bc_reg(b, n->l.v);
+			if (!n->r.n && d >= 0) {
+				ip = bc_emit(b, BC_REF, NULL, d);
+				ip->a = a;
+				a = d;
+			}
+		}
+		if (!n->r.n)
+			return a;
+		ip = bc_emit(b, BC_ELEM, NULL, d);
+		ip->a = a;
+		ip->b = r;
+		return ip->d;
+
+	case OC_FIELD:
+		a = bc_expr(b, n->r.n, -1);
+		ip = bc_emit(b, BC_FIELD, n, d);
+		ip->a = a;
+		return ip->d;
+
+	case OC_UNARY:
+		a = bc_expr(b, n->r.n, -1);
+		ip = bc_emit(b, BC_UNARY, n, d);
+		ip->a = a;
+		return ip->d;
+
+	case OC_MATCH:
+		a = bc_expr(b, n->l.n, -1);
+		ip = bc_emit(b, BC_MATCH, n, d);
+		ip->a = a;
+		ip->x.n = n->r.n;
+		return ip->d;
+
+	case OC_REGEXP:
+		ip = bc_emit(b, BC_REGEXP, n, d);
+		ip->x.n = n;
+		return ip->d;
+
+	case OC_BINARY:
+	case OC_REPLACE:
+	case OC_MOVE:
+	case OC_COMPARE:
+	case OC_CONCAT:
+	case OC_COMMA:
+	case OC_IN: {
+		static const uint8_t bc_op[] ALIGN1 = {
+			[XC(OC_BINARY  - OC_BINARY)] = BC_BINARY,
+			[XC(OC_REPLACE - OC_BINARY)] = BC_REPLACE,
+			[XC(OC_MOVE    - OC_BINARY)] = BC_MOVE,
+			[XC(OC_COMPARE - OC_BINARY)] = BC_COMPARE,
+			[XC(OC_CONCAT  - OC_BINARY)] = BC_CONCAT,
+			[XC(OC_COMMA   - OC_BINARY)] = BC_CONCAT,
+			[XC(OC_IN      - OC_BINARY)] = BC_IN,
+		};
+		a = bc_expr(b, n->l.n, -1);
+		r = bc_expr(b, n->r.n, -1);
+		ip = bc_emit(b, bc_op[XC((n->info & OPCLSMASK) - OC_BINARY)], n, d);
+		ip->a = a;
+		ip->b = r;
+		/* OC_COMMA has no opn of its own: mark it for l_CONCAT */
+		if ((n->info & OPCLSMASK) == OC_COMMA)
+			ip->opn = ',';
+		return ip->d;
+	}
+
+	case OC_LAND:
+	case OC_LOR:
+		a = bc_expr(b, n->l.n, -1);
+		ip = bc_emit(b, (n->info & OPCLSMASK) == OC_LAND ? BC_LAND : BC_LOR, n, d);
+		ip->a = a;
+		d = ip->d;
+		j = b->ninsn - 1;
+		a = bc_expr(b, n->r.n, -1);
+		ip = bc_emit(b, BC_BOOL, n, d);
+		ip->a = a;
+		b->insn[j].x.jmp = b->ninsn;
+		return d;
+
+	case OC_TERNARY:
+		if ((n->r.n->info & OPCLSMASK) != OC_COLON)
+			break;
+		a = bc_expr(b, n->l.n, -1);
+		if (d < 0)
+			d = bc_reg(b, NULL);
+		ip = bc_emit(b, BC_JFALSE, n, d);
+		ip->a = a;
+		j = b->ninsn - 1;
+		bc_expr(b, n->r.n->l.n, d);
+		a = b->ninsn;
+		bc_emit(b, BC_JMP, n, d);
+		b->insn[j].x.jmp = b->ninsn;
+		j = a;
+		bc_expr(b, n->r.n->r.n, d);
+		b->insn[j].x.jmp = b->ninsn;
+		return d;
+	}
+
+	ip = bc_emit(b, BC_CALL, n, d);
+	ip->x.n = n;
+	return ip->d;
+}
+
+static bcprog *bc_compile(node *n)
+{
+	bcbuild b;
+	bcprog *p;
+
+	switch (n->info & OPCLSMASK) {
+	case OC_VAR:
+	case OC_FNARG:
+		if (!n->r.n)
+			return &G.bc_none;
+		/* fall through */
+	case OC_BINARY:
+	case OC_REPLACE:
+	case OC_MOVE:
+	case OC_COMPARE:
+	case OC_CONCAT:
+	case OC_COMMA:
+	case OC_IN:
+	case OC_FIELD:
+	case OC_UNARY:
+	case OC_MATCH:
+	case OC_LAND:
+	case OC_LOR:
+	case OC_TERNARY:
+		break;
+	default: /* BC_CALL of itself would be an endless loop */
+		return &G.bc_none;
+	}
+
+	memset(&b, 0, sizeof(b));
+	bc_reg(&b, NULL); /* reg[0] is the result */
+	bc_expr(&b, n, 0);
+	bc_emit(&b, BC_END, NULL, 0);
+	if (b.nreg >= BC_MAXREG) {
+		free(b.insn);
+		free(b.reg);
+		return &G.bc_none;
+	}
+
+	p = xzalloc(sizeof(*p));
+	p->insn = b.insn;
+	p->reg = b.reg;
+	p->tmp = xzalloc(b.nreg * sizeof(p->tmp[0]));
+	return p;
+}
+
+static var *bc_run(bcprog *p, var *res)
+{
+	static const void *const bc_label[] = {
+		&&l_END, &&l_REF, &&l_NF, &&l_FNARG, &&l_ELEM, &&l_FIELD,
+		&&l_BINARY, &&l_REPLACE, &&l_MOVE, &&l_COMPARE, &&l_UNARY,
+		&&l_CONCAT, &&l_MATCH, &&l_REGEXP, &&l_IN,
+		&&l_JFALSE, &&l_JMP, &&l_LAND, &&l_LOR, &&l_BOOL, &&l_CALL,
+	};
+	const bcinsn *ip = p->insn;
+	var **reg = p->reg;
+	const char *s;
+	int i;
+
+/* where value of an unbound register goes */
+#define OUT   (ip->d ? &p->tmp[ip->d] : res)
+#define NEXT  goto *bc_label[(++ip)->op]
+#define JUMP  do { ip = p->insn + ip->x.jmp; goto *bc_label[ip->op]; } while (0)
+
+	p->busy = 1;
+	goto *bc_label[ip->op];
+
+ l_REF:
+	reg[ip->d] = reg[ip->a];
+	NEXT;
+ l_NF:
+	reg[ip->d] = intvar[NF];
+	split_f0();
+	NEXT;
+ l_FNARG:
+	reg[ip->d] = &G.evaluate__fnargs[ip->x.aidx];
+	NEXT;
+ l_ELEM:
+	reg[ip->d] = findvar(iamarray(reg[ip->a]), getvar_s(reg[ip->b]));
+	NEXT;
+ l_FIELD:
+	i = (int)getvar_i(reg[ip->a]);
+	if (i == 0) {
+		reg[ip->d] = intvar[F0];
+	} else {
+		split_f0();
+		if (i > nfields)
+			fsrealloc(i);
+		set_fields(i);
+		reg[ip->d] = &Fields[i - 1];
+	}
+	NEXT;
+ l_BINARY:
+ l_REPLACE: {
+	double L_d = getvar_i(reg[ip->a]);
+	double R_d = getvar_i(reg[ip->b]);
+
+	g_lineno = ip->lineno;
+	L_d = arith_op(ip->opn, L_d, R_d);
+	reg[ip->d] = setvar_i(ip->op == BC_BINARY ? OUT : reg[ip->a], L_d);
+	NEXT;
+ }
+ l_MOVE:
+	reg[ip->d] = copyvar(reg[ip->a], reg[ip->b]);
+	NEXT;
+ l_COMPARE:
+	reg[ip->d] = setvar_i(OUT, compare_op(ip->opn, reg[ip->a], reg[ip->b]));
+	NEXT;
+ l_UNARY:
+	reg[ip->d] = setvar_i(OUT, unary_op(ip->opn, reg[ip->a]));
+	NEXT;
+ l_CONCAT: {
+	const char *sep = "";
+	s = getvar_s(reg[ip->a]);
+	if (ip->opn == ',')
+		sep = getvar_s(intvar[SUBSEP]);
+	reg[ip->d] = setvar_p(OUT, xasprintf("%s%s%s", s, sep, getvar_s(reg[ip->b])));
+	NEXT;
+ }
+ l_MATCH:
+	s = getvar_s(reg[ip->a]);
+	goto re_cont;
+ l_REGEXP:
+	s = getvar_s(intvar[F0]);
+ re_cont:
+	i = regexec(as_regex(ip->x.n), s, 0, NULL, 0);
+	reg[ip->d] = setvar_i(OUT, (i == 0) ^ (ip->opn == '!'));
+	NEXT;
+ l_IN:
+	s = getvar_s(reg[ip->a]);
+	reg[ip->d] = setvar_i(OUT, hash_search(iamarray(reg[ip->b]), s) ? 1 : 0);
+	NEXT;
+ l_JFALSE:
+	if (!istrue(reg[ip->a]))
+		JUMP;
+	NEXT;
+ l_JMP:
+	JUMP;
+ l_LAND:
+	if (!istrue(reg[ip->a])) {
+		reg[ip->d] = setvar_i(OUT, 0);
+		JUMP;
+	}
+	NEXT;
+ l_LOR:
+	if (istrue(reg[ip->a])) {
+		reg[ip->d] = setvar_i(OUT, 1);
+		JUMP;
+	}
+	NEXT;
+ l_BOOL:
+	reg[ip->d] = setvar_i(OUT, istrue(reg[ip->a]));
+	NEXT;
+ l_CALL:
+	reg[ip->d] = evaluate(ip->x.n, OUT);
+	NEXT;
+ l_END:
+	p->busy = 0;
+	return reg[0];
+#undef OUT
+#undef NEXT
+#undef JUMP
+}
+#endif
+
 /*
  * Evaluate node - the heart of the program. Supplied with subtree
  * and place where to store result. returns ptr to result.
  */
-#define XC(n) ((n) >> 8)
-
 static var *evaluate(node *op, var *res)
 {
 /* This procedure is recursive so we should count every byte */
 #define fnargs (G.evaluate__fnargs)
 /* seed is initialized to 1 */
 #define seed   (G.evaluate__seed)
-#define sreg   (G.evaluate__sreg)
 
 	var *v1;
 
 	if (!op)
 		return setvar_s(res, NULL);
 
+#if ENABLE_FEATURE_AWK_COMPILE
+	if ((op->info & OPCLSMASK) >= RECUR_FROM_THIS) {
+		if (!op->bc)
+			op->bc = bc_compile(op);
+		if (!op->bc->busy)
+			return bc_run(op->bc, res);
+	}
+#endif
+
 	debug_printf_eval("entered %s()\n", __func__);
 
 	v1 = nvalloc(2);
@@ -2682,10 +3356,8 @@ static var *evaluate(node *op, var *res)
 			op1 = op->r.n;
  re_cont:
 			{
-				regex_t *re = as_regex(op1, &sreg);
+				regex_t *re = as_regex(op1);
 				int i = regexec(re, L.s, 0, NULL, 0);
-				if (re == &sreg)
-					regfree(re);
 				setvar_i(res, (i == 0) ^ (opn == '!'));
 			}
 			break;
@@ -2881,6 +3553,7 @@ static var *evaluate(node *op, var *res)
 					 */
 					if (rsm->F)
 						err = rsm->is_pipe ? pclose(rsm->F) : fclose(rsm->F);
+					detach_f0(rsm);
 					free(rsm->buffer);
 					hash_remove(fdhash, L.s);
 				}
@@ -2902,35 +3575,9 @@ static var *evaluate(node *op, var *res)
 			setvar_p(res, awk_printf(op1));
 			break;
 
-		case XC( OC_UNARY ): {
-			double Ld, R_d;
-
-			Ld = R_d = getvar_i(R.v);
-			switch (opn) {
-			case 'P':
-				Ld = ++R_d;
-				goto r_op_change;
-			case 'p':
-				R_d++;
-				goto r_op_change;
-			case 'M':
-				Ld = --R_d;
-				goto r_op_change;
-			case 'm':
-				R_d--;
- r_op_change:
-				setvar_i(R.v, R_d);
-				break;
-			case '!':
-				Ld = !istrue(R.v);
-				break;
-			case '-':
-				Ld = -R_d;
-				break;
-			}
-			setvar_i(res, Ld);
+		case XC( OC_UNARY ):
+			setvar_i(res, unary_op(opn, R.v));
 			break;
-		}
 
 		case XC( OC_FIELD ): {
 			int i = (int)getvar_i(R.v);
@@ -2940,6 +3587,7 @@ static var *evaluate(node *op, var *res)
 				split_f0();
 				if (i > nfields)
 					fsrealloc(i);
+				set_fields(i);
 				res = &Fields[i - 1];
 			}
 			break;
@@ -2967,63 +3615,15 @@ static var *evaluate(node *op, var *res)
 		case XC( OC_REPLACE ): {
 			double R_d = getvar_i(R.v);
 			debug_printf_eval("BINARY/REPLACE: R_d:%f opn:%c\n", R_d, opn);
-			switch (opn) {
-			case '+':
-				L_d += R_d;
-				break;
-			case '-':
-				L_d -= R_d;
-				break;
-			case '*':
-				L_d *= R_d;
-				break;
-			case '/':
-				if (R_d == 0)
-					syntax_error(EMSG_DIV_BY_ZERO);
-				L_d /= R_d;
-				break;
-			case '&':
-				if (ENABLE_FEATURE_AWK_LIBM)
-					L_d = pow(L_d, R_d);
-				else
-					syntax_error(EMSG_NO_MATH);
-				break;
-			case '%':
-				if (R_d == 0)
-					syntax_error(EMSG_DIV_BY_ZERO);
-				L_d -= (long long)(L_d / R_d) * R_d;
-				break;
-			}
+			L_d = arith_op(opn, L_d, R_d);
 			debug_printf_eval("BINARY/REPLACE result:%f\n", L_d);
 			res = setvar_i(((opinfo & OPCLSMASK) == OC_BINARY) ? res : L.v, L_d);
 			break;
 		}
 
-		case XC( OC_COMPARE ): {
-			static int i;
-			double Ld;
-
-			if (is_numeric(L.v) && is_numeric(R.v)) {
-				Ld = getvar_i(L.v) - getvar_i(R.v);
-			} else {
-				const char *l = getvar_s(L.v);
-				const char *r = getvar_s(R.v);
-				Ld = icase ? strcasecmp(l, r) : strcmp(l, r);
-			}
-			switch (opn & 0xfe) {
-			case 0:
-				i = (Ld > 0);
-				break;
-			case 2:
-				i = (Ld >= 0);
-				break;
-			case 4:
-				i = (Ld == 0);
-				break;
-			}
-			setvar_i(res, (i == 0) ^ (opn & 1));
+		case XC( OC_COMPARE ):
+			setvar_i(res, compare_op(opn, L.v, R.v));
 			break;
-		}
 
 		default:
 			syntax_error(EMSG_POSSIBLE_ERROR);
@@ -3041,7 +3641,6 @@ static var *evaluate(node *op, var *res)
 	return res;
 #undef fnargs
 #undef seed
-#undef sreg
 }
 
 
@@ -3061,14 +3660,16 @@ static int awk_exit(int r)
 		evaluate(endseq.first, &tv);
 	}
 
+#if DEBUG_RE_CACHE
+	bb_error_msg("regex cache: %u hits, %u misses",
+		G.re_cache_hits, G.re_cache_misses);
+#endif
+
 	/* waiting for children */
-	for (i = 0; i < fdhash->csize; i++) {
+	for (i = 0; i < fdhash->nitems; i++) {
 		hi = fdhash->items[i];
-		while (hi) {
-			if (hi->data.rs.F && hi->data.rs.is_pipe)
-				pclose(hi->data.rs.F);
-			hi = hi->next;
-		}
+		if (hi && hi->data.rs.F && hi->data.rs.is_pipe)
+			pclose(hi->data.rs.F);
 	}
 
 	exit(r);
@@ -98,13 +98,32 @@
 //config:	help
 //config:	  This option enables support for directory and subdirectory
 //config:	  comparison.
+//config:
+//config:config FEATURE_DIFF_PARALLEL
+//config:	bool "Support -j N to compare directories in parallel"
+//config:	default y
+//config:	depends on FEATURE_DIFF_DIR && !NOMMU
+//config:	help
+//config:	  When comparing directories, compare up to N pairs of files
+//config:	  at once, each in a forked copy of diff. Output stays in
+//config:	  the same order as without -j.
+//config:
+//config:config FEATURE_DIFF_MYERS
+//config:	bool "Use Myers' algorithm on large files"
+//config:	default y
+//config:	depends on DIFF
+//config:	help
+//config:	  Compare large files with Myers' O(ND) algorithm instead of
+//config:	  the default Hunt-McIlroy one. It needs less memory and is
+//config:	  much faster when the files differ in few places.
+//config:	  With long options, --algorithm=myers|stone forces the choice.
 
 //kbuild:lib-$(CONFIG_DIFF) += diff.o
 
 //applet:IF_DIFF(APPLET(diff, BB_DIR_USR_BIN, BB_SUID_DROP))
 
 //usage:#define diff_trivial_usage
-//usage:       "[-abBdiNqrTstw] [-L LABEL] [-S FILE] [-U LINES] FILE1 FILE2"
+//usage:       "[-abBdiNqrTstw] "IF_FEATURE_DIFF_PARALLEL("[-j N] ")"[-L LABEL] [-S FILE] [-U LINES] FILE1 FILE2"
 //usage:#define diff_full_usage "\n\n"
 //usage:       "Compare files line by line and output the differences between them.\n"
 //usage:       "This implementation supports unified diffs only.\n"
@@ -113,6 +132,9 @@
 //usage:     "\n	-B	Ignore changes whose lines are all blank"
 //usage:     "\n	-d	Try hard to find a smaller set of changes"
 //usage:     "\n	-i	Ignore case differences"
+//usage:	IF_FEATURE_DIFF_PARALLEL(
+//usage:     "\n	-j N	Compare N pairs of files at once (directories only)"
+//usage:	)
 //usage:     "\n	-L	Use LABEL instead of the filename in the unified header"
 //usage:     "\n	-N	Treat absent files as empty"
 //usage:     "\n	-q	Output only whether files differ"
@@ -157,6 +179,7 @@ enum {                  /* Commandline flags */
 	FLAG_p,         /* not implemented */
 	FLAG_B,
 	FLAG_E,         /* not implemented */
+	IF_FEATURE_DIFF_PARALLEL(FLAG_j,) /* never used, handled by getopt32 */
 };
 #define FLAG(x) (1 << FLAG_##x)
 
@@ -166,12 +189,37 @@ typedef struct FILE_and_pos_t {
 	off_t ft_pos;
 } FILE_and_pos_t;
 
+enum {                  /* --algorithm=ALGO */
+	ALGO_AUTO,      /* Myers above MYERS_MIN_LINES, else stone */
+	ALGO_STONE,
+	ALGO_MYERS,
+};
+
 struct globals {
 	smallint exit_status;
+	IF_FEATURE_DIFF_MYERS(smallint algorithm;)
 	int opt_U_context;
 	const char *other_dir;
 	char *label[2];
 	struct stat stb[2];
+#if ENABLE_FEATURE_DIFF_PARALLEL
+	unsigned opt_j;
+	/* forked comparisons, oldest first */
+	unsigned jobs_first, jobs_cnt;
+	struct diff_job {
+		pid_t pid;
+		int fd;         /* temp file with its output */
+	} *jobs;
+	/* file pairs for the next one */
+	unsigned batch_cnt;
+	off_t batch_bytes;
+	struct diff_pair {
+		char *fullpath[2];
+		struct stat st[2];
+		bool dev_null[2]; /* -N: compare against /dev/null */
+		bool same_inode;
+	} *batch;
+#endif
 };
 #define G (*ptr_to_globals)
 #define exit_status        (G.exit_status       )
@@ -181,6 +229,7 @@ struct globals {
 #define INIT_G() do { \
 	SET_PTR_TO_GLOBALS(xzalloc(sizeof(G))); \
 	opt_U_context = 3; \
+	IF_FEATURE_DIFF_PARALLEL(G.opt_j = 1;) \
 } while (0)
 
 typedef int token_t;
@@ -422,6 +471,172 @@ static int line_compar(const void *a, const void *b)
 #undef l1
 }
 
+/* Allocates the match vector J with the common prefix and suffix
+ * matched, and everything in between unmatched.
+ */
+static int *new_J(const int nlen[2], int pref, int suff)
+{
+	int *J = xmalloc((nlen[0] + 2) * sizeof(J[0]));
+	int i, delta;
+
+	for (i = 0, delta = nlen[1] - nlen[0]; i <= nlen[0]; i++)
+		J[i] = i <= pref            ?  i :
+		       i > (nlen[0] - suff) ? (i + delta) : 0;
+	return J;
+}
+
+#if ENABLE_FEATURE_DIFF_MYERS
+/* Myers' O(ND) algorithm, linear space variant (E. Myers, "An O(ND)
+ * Difference Algorithm and Its Variations", 1986, section 4b).
+ * A furthest reaching D-path is grown from both ends at once
+ * until the two meet; the "middle snake" where they meet splits
+ * the problem in two, which are solved recursively. Only the
+ * two vectors of furthest reaching x (per diagonal k = x - y)
+ * are needed, thus memory is O(N+M) instead of O(N*M).
+ */
+
+/* Files with fewer lines than this (not counting the common head
+ * and tail) are left to stone(): it is fast enough there, and their
+ * diffs stay exactly as they always were */
+#define MYERS_MIN_LINES 4096
+
+struct myers {
+	const struct line *a, *b;
+	int *J;
+	int *vf;        /* forward: furthest x on diagonal k */
+	int *vb;        /* backward: furthest distance from the end on diagonal k */
+	int max_d;      /* give up if edit distance is bigger */
+};
+
+/* Finds the middle snake of a[a_lo..a_hi) vs b[b_lo..b_hi),
+ * stores its ends to s[0..3]. Returns the edit distance
+ * or -1 if it is bigger than m->max_d.
+ */
+static int myers_snake(struct myers *m, int a_lo, int a_hi, int b_lo, int b_hi, int s[4])
+{
+	const struct line *a = m->a, *b = m->b;
+	int *vf = m->vf, *vb = m->vb;
+	int n = a_hi - a_lo;
+	int delta = n - (b_hi - b_lo);
+	int d, dmax = (n + (b_hi - b_lo) + 1) / 2;
+
+	vf[1] = vb[1] = 0;
+	for (d = 0; d <= dmax; d++) {
+		int k;
+
+		if (d > m->max_d)
+			return -1;
+		for (k = -d; k <= d; k += 2) {
+			int x, y, x0;
+
+			if (k == -d || (k != d && vf[k - 1] < vf[k + 1]))
+				x = vf[k + 1];
+			else
+				x = vf[k - 1] + 1;
+			y = x - k;
+			x0 = x;
+			while (a_lo + x < a_hi && b_lo + y < b_hi
+			 && a[a_lo + x].value == b[b_lo + y].value
+			) {
+				x++, y++;
+			}
+			vf[k] = x;
+			/* Does it overlap the backward (d-1)-path on this diagonal? */
+			if ((delta & 1) && delta - k >= 1 - d && delta - k <= d - 1
+			 && x + vb[delta - k] >= n
+			) {
+				s[0] = a_lo + x0;
+				s[1] = b_lo + x0 - k;
+				s[2] = a_lo + x;
+				s[3] = b_lo + y;
+				return 2 * d - 1;
+			}
+		}
+		for (k = -d; k <= d; k += 2) {
+			int u, v, u0;
+
+			if (k == -d || (k != d && vb[k - 1] < vb[k + 1]))
+				u = vb[k + 1];
+			else
+				u = vb[k - 1] + 1;
+			v = u - k;
+			u0 = u;
+			while (a_lo + u < a_hi && b_lo + v < b_hi
+			 && a[a_hi - 1 - u].value == b[b_hi - 1 - v].value
+			) {
+				u++, v++;
+			}
+			vb[k] = u;
+			/* Does it overlap the forward d-path on this diagonal? */
+			if (!(delta & 1) && delta - k >= -d && delta - k <= d
+			 && u + vf[delta - k] >= n
+			) {
+				s[0] = a_hi - u;
+				s[1] = b_hi - v;
+				s[2] = a_hi - u0;
+				s[3] = b_hi - (u0 - k);
+				return 2 * d;
+			}
+		}
+	}
+	return -1; /* not reached */
+}
+
+static bool myers_lcs(struct myers *m, int a_lo, int a_hi, int b_lo, int b_hi)
+{
+	int s[4], x, y;
+
+	/* Matching lines at either end are matched, period */
+	while (a_lo < a_hi && b_lo < b_hi && m->a[a_lo].value == m->b[b_lo].value)
+		m->J[a_lo++] = b_lo++;
+	while (a_lo < a_hi && b_lo < b_hi && m->a[a_hi - 1].value == m->b[b_hi - 1].value)
+		m->J[--a_hi] = --b_hi;
+	/* Only insertions or only deletions left? */
+	if (a_lo == a_hi || b_lo == b_hi)
+		return true;
+
+	/* Here the edit distance is at least 2, and both halves
+	 * around the middle snake have a smaller one */
+	if (myers_snake(m, a_lo, a_hi, b_lo, b_hi, s) < 0)
+		return false;
+	for (x = s[0], y = s[1]; x < s[2]; x++, y++)
+		m->J[x] = y;
+	return myers_lcs(m, a_lo, s[0], b_lo, s[1])
+	    && myers_lcs(m, s[2], a_hi, s[3], b_hi);
+}
+
+/* Fills J for lines pref+1..nlen-suff. Returns NULL if the files differ
+ * too much for Myers to be faster than stone().
+ */
+static int *myers_J(struct line *nfile[2], const int nlen[2], int pref, int suff)
+{
+	struct myers m;
+	int *J = new_J(nlen, pref, suff);
+	int n = nlen[0] + nlen[1] - 2 * (pref + suff);
+	int *v = xmalloc((2 * n + 8) * sizeof(v[0]));
+	bool ok;
+
+	m.a = nfile[0];
+	m.b = nfile[1];
+	m.J = J;
+	/* diagonals -(D+1)..D+1 with D <= (n+1)/2 */
+	m.vf = v + n / 2 + 2;
+	m.vb = m.vf + n + 4;
+	/* Without -d, bail out well before O(N*D) gets expensive */
+	m.max_d = INT_MAX;
+	if (G.algorithm != ALGO_MYERS && !(option_mask32 & FLAG(d)))
+		m.max_d = MAX(256, 4 * isqrt(n));
+	ok = myers_lcs(&m, pref + 1, nlen[0] - suff + 1, pref + 1, nlen[1] - suff + 1);
+	free(v);
+	if (!ok) {
+		dbg_error_msg("myers: too many changes, using stone");
+		free(J);
+		return NULL;
+	}
+	return J;
+}
+#endif
+
 static void fetch(FILE_and_pos_t *ft, const off_t *ix, int a, int b, int ch)
 {
 	int i, j, col;
@@ -465,7 +680,7 @@ static NOINLINE int *create_J(FILE_and_pos_t ft[2], int nlen[2], off_t *ix[2])
 {
 	int *J, slen[2], *class, *member;
 	struct line *nfile[2], *sfile[2];
-	int pref = 0, suff = 0, i, j, delta;
+	int pref = 0, suff = 0, i, j;
 
 	/* Lines of both files are hashed, and in the process
 	 * their offsets are stored in the array ix[fileno]
@@ -527,6 +742,19 @@ start:
 	for (; suff < nlen[0] - pref && suff < nlen[1] - pref &&
 	       nfile[0][nlen[0] - suff].value == nfile[1][nlen[1] - suff].value;
 	       suff++);
+#if ENABLE_FEATURE_DIFF_MYERS
+	if (G.algorithm == ALGO_MYERS
+	 || (G.algorithm == ALGO_AUTO
+	    && nlen[0] + nlen[1] - 2 * (pref + suff) >= MYERS_MIN_LINES)
+	) {
+		J = myers_J(nfile, nlen, pref, suff);
+		if (J) {
+			free(nfile[0]);
+			free(nfile[1]);
+			goto check;
+		}
+	}
+#endif
 	/* Arrays are pruned by the suffix and prefix length,
 	 * the result being sorted and stored in sfile[fileno],
 	 * and their sizes are stored in slen[fileno]
@@ -562,21 +790,19 @@ start:
 	unsort(sfile[0], slen[0], (int *)nfile[0]);
 	class = xrealloc(class, (slen[0] + 2) * sizeof(class[0]));
 #endif
-	J = xmalloc((nlen[0] + 2) * sizeof(J[0]));
 	/* The elements of J which fall inside the prefix and suffix regions
 	 * are marked as unchanged, while the ones which fall outside
 	 * are initialized with 0 (no matches), so that function stone can
 	 * then assign them their right values
 	 */
-	for (i = 0, delta = nlen[1] - nlen[0]; i <= nlen[0]; i++)
-		J[i] = i <= pref            ?  i :
-		       i > (nlen[0] - suff) ? (i + delta) : 0;
+	J = new_J(nlen, pref, suff);
 	/* Here the magic is performed */
 	stone(class, slen[0], member, J, pref);
-	J[nlen[0] + 1] = nlen[1] + 1;
 
 	free(class);
 	free(member);
+ IF_FEATURE_DIFF_MYERS(check:)
+	J[nlen[0] + 1] = nlen[1] + 1;
 
 	/* Both files are rescanned, in an effort to find any lines
 	 * which, due to limitations intrinsic to any hashing algorithm,
@@ -718,12 +944,40 @@ static bool diff(FILE* fp[2], char *file[2])
 	return anychange;
 }
 
+/* Anonymous temporary file */
+static int xmktemp_unlinked(void)
+{
+	/* really should use $TMPDIR, but not usually set on android anyway
+	   here with ifdef, android will use "/data/local/tmp/difXXXXXX"
+	 */
+	char name[] =
+#ifdef __BIONIC__
+		"/data/local"
+#endif
+		"/tmp/difXXXXXX";
+	int fd = xmkstemp(name);
+
+	unlink(name);
+	return fd;
+}
+
 static int diffreg(char *file[2])
 {
 	FILE *fp[2];
 	bool binary = false, differ = false;
+	/* -q needs to know only whether files differ. Unless we ignore
+	 * whitespace, case or blank lines, any differing byte tells that */
+	bool brief = (option_mask32 & (FLAG(q) | FLAG(b) | FLAG(w) | FLAG(i) | FLAG(B))) == FLAG(q);
 	int status = STATUS_SAME, i;
 
+	if (brief
+	 && S_ISREG(stb[0].st_mode) && S_ISREG(stb[1].st_mode)
+	 && stb[0].st_size != stb[1].st_size
+	) {
+		exit_status |= 1;
+		return STATUS_DIFFER;
+	}
+
 	fp[0] = stdin;
 	fp[1] = stdin;
 	for (i = 0; i < 2; i++) {
@@ -734,17 +988,8 @@ static int diffreg(char *file[2])
 		 * When we meet non-seekable file, we must make a temp copy.
 		 */
 		if (lseek(fd, 0, SEEK_SET) == -1 && errno == ESPIPE) {
-			/* really should use $TMPDIR, but not usually set on android anyway
-			   here with ifdef, android will use "/data/local/tmp/difXXXXXX"
-			 */
-			char name[] = 
-#ifdef __BIONIC__
-				"/data/local"
-#endif
-				"/tmp/difXXXXXX";
-			int fd_tmp = xmkstemp(name);
+			int fd_tmp = xmktemp_unlinked();
 
-			unlink(name);
 			if (bb_copyfd_eof(fd, fd_tmp) < 0)
 				xfunc_die();
 			if (fd) /* Prevents closing of stdin */
@@ -773,11 +1018,13 @@ static int diffreg(char *file[2])
 			if (buf0[k] != buf1[k])
 				differ = true;
 		}
+		if (differ && brief)
+			break;
 	}
 	if (differ) {
 		if (binary && !(option_mask32 & FLAG(a)))
 			status = STATUS_BINARY;
-		else if (diff(fp, file))
+		else if (brief || diff(fp, file))
 			status = STATUS_DIFFER;
 	}
 	if (status != STATUS_SAME)
@@ -861,6 +1108,126 @@ static int FAST_FUNC skip_dir(const char *filename,
 	return TRUE;
 }
 
+#if ENABLE_FEATURE_DIFF_PARALLEL
+/* -j N: consecutive pairs of files are batched, and each batch is
+ * compared by a forked copy of diff, up to N at once. A batch writes
+ * to its own temp file, which is copied to stdout when all batches
+ * before it are done, thus output order does not change.
+ * Batching amortizes fork(), which costs more than comparing
+ * two small files which are in page cache.
+ */
+#define DIFF_BATCH_FILES 64
+#define DIFF_BATCH_BYTES (1024 * 1024)
+
+/* Waits for jobs, oldest first, until at most 'keep' are running,
+ * and copies their output to stdout.
+ */
+static void wait_diff_jobs(unsigned keep)
+{
+	fflush_all();
+	while (G.jobs_cnt > keep) {
+		struct diff_job *job = &G.jobs[G.jobs_first];
+		int status;
+
+		if (safe_waitpid(job->pid, &status, 0) > 0 && status != 0)
+			exit_status |= 1;
+		xlseek(job->fd, 0, SEEK_SET);
+		if (bb_copyfd_eof(job->fd, STDOUT_FILENO) < 0)
+			xfunc_die();
+		close(job->fd);
+		G.jobs_first = (G.jobs_first + 1) % G.opt_j;
+		G.jobs_cnt--;
+	}
+}
+
+static void free_batch(void)
+{
+	while (G.batch_cnt) {
+		struct diff_pair *pr = &G.batch[--G.batch_cnt];
+		free(pr->fullpath[0]);
+		free(pr->fullpath[1]);
+	}
+	G.batch_bytes = 0;
+}
+
+static void run_batch(void)
+{
+	struct stat save_stb[2];
+	unsigned n;
+
+	memcpy(save_stb, stb, sizeof(stb));
+	for (n = 0; n < G.batch_cnt; n++) {
+		struct diff_pair *pr = &G.batch[n];
+		char *path[2];
+		int i;
+
+		for (i = 0; i < 2; i++)
+			path[i] = pr->dev_null[i] ? (char *)bb_dev_null : pr->fullpath[i];
+		memcpy(stb, pr->st, sizeof(stb));
+		print_status(pr->same_inode ? STATUS_SAME : diffreg(path), pr->fullpath);
+	}
+	memcpy(stb, save_stb, sizeof(stb));
+	free_batch();
+}
+
+static void start_diff_job(void)
+{
+	struct diff_job *job;
+	int fd;
+	pid_t pid;
+
+	/* (this also flushes stdout before fork) */
+	wait_diff_jobs(G.opt_j - 1);
+	fd = xmktemp_unlinked();
+	pid = xfork();
+	if (pid == 0) {
+		xmove_fd(fd, STDOUT_FILENO);
+		run_batch();
+		fflush_stdout_and_exit(exit_status);
+	}
+	job = &G.jobs[(G.jobs_first + G.jobs_cnt++) % G.opt_j];
+	job->pid = pid;
+	job->fd = fd;
+	free_batch();
+}
+
+/* Outputs everything queued so far */
+static void sync_diff_jobs(void)
+{
+	wait_diff_jobs(0);
+	/* Not worth a fork */
+	run_batch();
+}
+#else
+# define sync_diff_jobs() ((void)0)
+#endif
+
+/* Compares two regular files found in the directories */
+static void diff_files(char *path[2], char *fullpath[2], bool same_inode)
+{
+	/* Nothing to print for them, and it's certainly the same file */
+	if (same_inode && !(option_mask32 & FLAG(s)))
+		return;
+#if ENABLE_FEATURE_DIFF_PARALLEL
+	if (G.opt_j > 1) {
+		struct diff_pair *pr = &G.batch[G.batch_cnt++];
+		int i;
+
+		for (i = 0; i < 2; i++) {
+			pr->fullpath[i] = xstrdup(fullpath[i]);
+			pr->dev_null[i] = (path[i] != fullpath[i]);
+		}
+		memcpy(pr->st, stb, sizeof(stb));
+		pr->same_inode = same_inode;
+		G.batch_bytes += stb[0].st_size + stb[1].st_size;
+		if (G.batch_cnt == DIFF_BATCH_FILES || G.batch_bytes >= DIFF_BATCH_BYTES)
+			start_diff_job();
+		return;
+	}
+#endif
+	print_status(same_inode ? STATUS_SAME : diffreg(path), fullpath);
+}
+
 static void diffdir(char *p[2], const char *s_start)
 {
 	struct dlist list[2];
@@ -876,7 +1243,8 @@ static void diffdir(char *p[2], const char *s_start)
 		 * Using list.len to specify its length,
 		 * add_to_dirlist will remove it. */
 		list[i].len = strlen(p[i]);
-		recursive_action(p[i], ACTION_RECURSE | ACTION_FOLLOWLINKS,
+		recursive_action(p[i], ACTION_RECURSE | ACTION_FOLLOWLINKS
+				| ACTION_OPENAT | ACTION_TYPE_ONLY,
 				add_to_dirlist, skip_dir, &list[i], 0);
 		/* Sort dl alphabetically.
 		 * GNU diff does this ignoring any number of trailing dots.
@@ -906,6 +1274,7 @@ static void diffdir(char *p[2], const char *s_start)
 		pos = !dp[0] ? 1 : (!dp[1] ? -1 : strcmp(dp[0], dp[1]));
 		k = pos > 0;
 		if (pos && !(option_mask32 & FLAG(N))) {
+			sync_diff_jobs();
 			printf("Only in %s: %s\n", p[k], dp[k]);
 			exit_status |= 1;
 		} else {
@@ -923,19 +1292,24 @@ static void diffdir(char *p[2], const char *s_start)
 			if (pos)
 				stat(fullpath[k], &stb[1 - k]);
 
-			if (S_ISDIR(stb[0].st_mode) && S_ISDIR(stb[1].st_mode))
-				printf("Common subdirectories: %s and %s\n", fullpath[0], fullpath[1]);
-			else if (!S_ISREG(stb[0].st_mode) && !S_ISDIR(stb[0].st_mode))
-				printf("File %s is not a regular file or directory and was skipped\n", fullpath[0]);
-			else if (!S_ISREG(stb[1].st_mode) && !S_ISDIR(stb[1].st_mode))
-				printf("File %s is not a regular file or directory and was skipped\n", fullpath[1]);
-			else if (S_ISDIR(stb[0].st_mode) != S_ISDIR(stb[1].st_mode)) {
-				if (S_ISDIR(stb[0].st_mode))
+			if (S_ISREG(stb[0].st_mode) && S_ISREG(stb[1].st_mode)) {
+				diff_files(path, fullpath, pos == 0
+						&& stb[0].st_ino == stb[1].st_ino
+						&& stb[0].st_dev == stb[1].st_dev);
+			} else {
+				/* Output of the files before this one goes first */
+				sync_diff_jobs();
+				if (S_ISDIR(stb[0].st_mode) && S_ISDIR(stb[1].st_mode))
+					printf("Common subdirectories: %s and %s\n", fullpath[0], fullpath[1]);
+				else if (!S_ISREG(stb[0].st_mode) && !S_ISDIR(stb[0].st_mode))
+					printf("File %s is not a regular file or directory and was skipped\n", fullpath[0]);
+				else if (!S_ISREG(stb[1].st_mode) && !S_ISDIR(stb[1].st_mode))
+					printf("File %s is not a regular file or directory and was skipped\n", fullpath[1]);
+				else if (S_ISDIR(stb[0].st_mode))
 					printf("File %s is a %s while file %s is a %s\n", fullpath[0], "directory", fullpath[1], "regular file");
 				else
 					printf("File %s is a %s while file %s is a %s\n", fullpath[0], "regular file", fullpath[1], "directory");
-			} else
-				print_status(diffreg(path), fullpath);
+			}
 
 			free(fullpath[0]);
 			free(fullpath[1]);
@@ -947,6 +1321,7 @@ static void diffdir(char *p[2], const char *s_start)
 			list[1 - k].s++;
 		}
 	}
+	sync_diff_jobs();
 	if (ENABLE_FEATURE_CLEAN_UP) {
 		free(list[0].dl);
 		free(list[1].dl);
@@ -973,6 +1348,9 @@ static const char diff_longopts[] ALIGN1 =
 	"report-identical-files\0"   No_argument       "s"
 	"starting-file\0"            Required_argument "S"
 	"minimal\0"                  No_argument       "d"
+# if ENABLE_FEATURE_DIFF_MYERS
+	"algorithm\0"                Required_argument "\xff" /* no short option */
+# endif
 	;
 #endif
 
@@ -982,20 +1360,32 @@ int diff_main(int argc UNUSED_PARAM, char **argv)
 	int gotstdin = 0, i;
 	char *file[2], *s_start = NULL;
 	llist_t *L_arg = NULL;
+#if ENABLE_FEATURE_DIFF_LONG_OPTIONS && ENABLE_FEATURE_DIFF_MYERS
+	char *algo = NULL;
+#endif
 
 	INIT_G();
 
 	/* exactly 2 params; collect multiple -L <label>; -U N */
-	opt_complementary = "=2:L::U+";
+	opt_complementary = "=2:L::U+" IF_FEATURE_DIFF_PARALLEL(":j+");
 #if ENABLE_FEATURE_DIFF_LONG_OPTIONS
 	applet_long_options = diff_longopts;
 #endif
-	getopt32(argv, "abdiL:NqrsS:tTU:wupBE",
-			&L_arg, &s_start, &opt_U_context);
+	getopt32(argv, "abdiL:NqrsS:tTU:wupBE" IF_FEATURE_DIFF_PARALLEL("j:"),
+			&L_arg, &s_start, &opt_U_context
+			IF_FEATURE_DIFF_PARALLEL(, &G.opt_j)
+			IF_FEATURE_DIFF_LONG_OPTIONS(IF_FEATURE_DIFF_MYERS(, &algo)));
 	argv += optind;
 	while (L_arg)
 		label[!!label[0]] = llist_pop(&L_arg);
 	xfunc_error_retval = 2;
+#if ENABLE_FEATURE_DIFF_LONG_OPTIONS && ENABLE_FEATURE_DIFF_MYERS
+	if (algo) {
+		G.algorithm = index_in_strings("stone\0""myers\0", algo) + 1;
+		if (!G.algorithm)
+			bb_error_msg_and_die("unknown algorithm '%s'", algo);
+	}
+#endif
 	for (i = 0; i < 2; i++) {
 		file[i] = argv[i];
 		/* Compat: "diff file name_which_doesnt_exist" exits with 2 */
@@ -1036,6 +1426,12 @@ int diff_main(int argc UNUSED_PARAM, char **argv)
 
 	if (S_ISDIR(stb[0].st_mode) && S_ISDIR(stb[1].st_mode)) {
 #if ENABLE_FEATURE_DIFF_DIR
+# if ENABLE_FEATURE_DIFF_PARALLEL
+		if (G.opt_j > 1) {
+			G.jobs = xmalloc(G.opt_j * sizeof(G.jobs[0]));
+			G.batch = xmalloc(DIFF_BATCH_FILES * sizeof(G.batch[0]));
+		}
+# endif
 		diffdir(file, s_start);
 #else
 		bb_error_msg_and_die("no support for directory comparison");
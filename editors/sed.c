@@ -61,19 +61,32 @@
 //config:	help
 //config:	  sed is used to perform text transformations on a file
 //config:	  or input from a pipeline.
+//config:
+//config:config FEATURE_SED_PARALLEL
+//config:	bool "Support -j N to edit files in parallel"
+//config:	default y
+//config:	depends on SED && !NOMMU
+//config:	help
+//config:	  With -i, edit up to N files at once, each one in a forked
+//config:	  copy of sed. Helps when many small files are edited and
+//config:	  the time goes to waiting for the disk.
 
 //kbuild:lib-$(CONFIG_SED) += sed.o
 
 //applet:IF_SED(APPLET(sed, BB_DIR_BIN, BB_SUID_DROP))
 
 //usage:#define sed_trivial_usage
-//usage:       "[-inrE] [-f FILE]... [-e CMD]... [FILE]...\n"
-//usage:       "or: sed [-inrE] CMD [FILE]..."
+//usage:       "[-inrE] "IF_FEATURE_SED_PARALLEL("[-j N] ")"[-f FILE]... [-e CMD]... [FILE]...\n"
+//usage:       "or: sed [-inrE] "IF_FEATURE_SED_PARALLEL("[-j N] ")"CMD [FILE]..."
 //usage:#define sed_full_usage "\n\n"
 //usage:       "	-e CMD	Add CMD to sed commands to be executed"
 //usage:     "\n	-f FILE	Add FILE contents to sed commands to be executed"
 //usage:     "\n	-i[SFX]	Edit files in-place (otherwise sends to stdout)"
 //usage:     "\n		Optionally back files up, appending SFX"
+//usage:	IF_FEATURE_SED_PARALLEL(
+//usage:     "\n	-j N	With -i, edit up to N files in parallel"
+//usage:     "\n		(hold space is not kept from file to file)"
+//usage:	)
 //usage:     "\n	-n	Suppress automatic printing of pattern space"
 //usage:     "\n	-r,-E	Use extended regex syntax"
 //usage:     "\n"
@@ -107,6 +120,8 @@ typedef struct sed_cmd_s {
 	regex_t *beg_match;     /* sed -e '/match/cmd' */
 	regex_t *end_match;     /* sed -e '/match/,/end_match/cmd' */
 	regex_t *sub_match;     /* For 's/sub_match/string/' */
+	char *sub_literal;      /* sub_match as a plain string, NULL if it needs regexec */
+	unsigned sub_literal_len;
 	int beg_line;           /* 'sed 1p'   0 == apply commands to all lines */
 	int beg_line_orig;      /* copy of the above, needed for -i */
 	int end_line;           /* 'sed 1,3p' 0 == one line only. -1 = last line ($) */
@@ -120,6 +135,8 @@ typedef struct sed_cmd_s {
 	unsigned invert:1;      /* the '!' after the address */
 	unsigned in_match:1;    /* Next line also included in match? */
 	unsigned sub_p:1;       /* (s) print option */
+	unsigned sub_anchored:1; /* (s) sub_literal must match at start of line */
+	unsigned sub_plain:1;   /* (s) replacement has no '&' or backslash */
 
 	char sw_last_char;      /* Last line written by (sw) had no '\n' */
 
@@ -193,12 +210,14 @@ static void sed_free_and_close_stuff(void)
 			regfree(sed_cmd->sub_match);
 			free(sed_cmd->sub_match);
 		}
+		free(sed_cmd->sub_literal);
 		free(sed_cmd->string);
 		free(sed_cmd);
 		sed_cmd = sed_cmd_next;
 	}
 
 	free(G.hold_space);
+	free(G.pipeline.buf);
 
 	if (G.current_fp)
 		fclose(G.current_fp);
@@ -373,6 +392,44 @@ static int parse_file_cmd(/*sed_cmd_t *sed_cmd,*/ const char *filecmdstr, char *
 	return idx;
 }
 
+/* If the s/// match string has no regex operators (other than a leading '^'),
+ * remember it as a plain string: do_subst_command() then finds it with
+ * strstr/strncmp instead of running regexec on every line.
+ */
+static void parse_subst_literal(sed_cmd_t *sed_cmd, const char *match, int cflags)
+{
+	const char *meta = (cflags & REG_EXTENDED) ? ".[*^$+?(){}|" : ".[*^$";
+	char *lit, *d;
+
+	if (cflags & REG_ICASE)
+		return;
+	if (*match == '^') {
+		sed_cmd->sub_anchored = 1;
+		match++;
+	}
+	lit = d = xmalloc(strlen(match) + 1);
+	while (*match) {
+		char c = *match++;
+		if (c == '\\') {
+			c = *match++;
+			/* "\." etc are literal, "\(", "\{", "\+", "\<"... are not */
+			if (!c || !strchr(".[]*^$\\/", c))
+				goto not_literal;
+		} else if (strchr(meta, c)) {
+			goto not_literal;
+		}
+		*d++ = c;
+	}
+	*d = '\0';
+	sed_cmd->sub_literal = lit;
+	sed_cmd->sub_literal_len = d - lit;
+	dbg("literal '%s' anchored:%d", lit, sed_cmd->sub_anchored);
+	return;
+ not_literal:
+	free(lit);
+	sed_cmd->sub_anchored = 0;
+}
+
 static int parse_subst_cmd(sed_cmd_t *sed_cmd, const char *substr)
 {
 	int cflags = G.regex_type;
@@ -454,8 +511,10 @@ static int parse_subst_cmd(sed_cmd_t *sed_cmd, const char *substr)
 		dbg("xregcomp('%s',%x)", match, cflags);
 		xregcomp(sed_cmd->sub_match, match, cflags);
 		dbg("regcomp ok");
+		parse_subst_literal(sed_cmd, match, cflags);
 	}
 	free(match);
+	sed_cmd->sub_plain = !strpbrk(sed_cmd->string, "&\\");
 
 	return idx;
 }
@@ -677,23 +736,35 @@ static void add_cmd(const char *cmdstr)
 	G.add_cmd_line = NULL;
 }
 
-/* Append to a string, reallocating memory as necessary. */
+/* Append to a string, reallocating memory as necessary.
+ * The buffer is kept between substitutions (see do_subst_command). */
 
 #define PIPE_GROW 64
 
-static void pipe_putc(char c)
+static void pipe_grow(int n)
 {
-	if (G.pipeline.idx == G.pipeline.len) {
-		G.pipeline.buf = xrealloc(G.pipeline.buf,
-				G.pipeline.len + PIPE_GROW);
-		G.pipeline.len += PIPE_GROW;
+	if (G.pipeline.idx + n > G.pipeline.len) {
+		G.pipeline.len += n + G.pipeline.len / 2 + PIPE_GROW;
+		G.pipeline.buf = xrealloc(G.pipeline.buf, G.pipeline.len);
 	}
+}
+
+static void pipe_putc(char c)
+{
+	pipe_grow(1);
 	G.pipeline.buf[G.pipeline.idx++] = c;
 }
 
+static void pipe_puts(const char *s, int n)
+{
+	pipe_grow(n);
+	memcpy(G.pipeline.buf + G.pipeline.idx, s, n);
+	G.pipeline.idx += n;
+}
+
 static void do_subst_w_backrefs(char *line, char *replace)
 {
-	int i, j;
+	int i;
 
 	/* go through the replacement string */
 	for (i = 0; replace[i]; i++) {
@@ -703,9 +774,8 @@ static void do_subst_w_backrefs(char *line, char *replace)
 			if (backref <= 9) {
 				/* print out the text held in G.regmatch[backref] */
 				if (G.regmatch[backref].rm_so != -1) {
-					j = G.regmatch[backref].rm_so;
-					while (j < G.regmatch[backref].rm_eo)
-						pipe_putc(line[j++]);
+					pipe_puts(line + G.regmatch[backref].rm_so,
+						G.regmatch[backref].rm_eo - G.regmatch[backref].rm_so);
 				}
 				continue;
 			}
@@ -718,9 +788,8 @@ static void do_subst_w_backrefs(char *line, char *replace)
 		}
 		/* if we find an unescaped '&' print out the whole matched text. */
 		if (replace[i] == '&') {
-			j = G.regmatch[0].rm_so;
-			while (j < G.regmatch[0].rm_eo)
-				pipe_putc(line[j++]);
+			pipe_puts(line + G.regmatch[0].rm_so,
+				G.regmatch[0].rm_eo - G.regmatch[0].rm_so);
 			continue;
 		}
 		/* Otherwise just output the character. */
@@ -728,6 +797,36 @@ static void do_subst_w_backrefs(char *line, char *replace)
 	}
 }
 
+/* regexec() replacement which knows about literal s/// patterns */
+static int subst_exec(sed_cmd_t *sed_cmd, regex_t *current_regex, const char *line, int eflags)
+{
+	const char *p;
+	int i;
+
+	if (current_regex != sed_cmd->sub_match || !sed_cmd->sub_literal)
+		return regexec(current_regex, line, 10, G.regmatch, eflags);
+
+	if (sed_cmd->sub_anchored) {
+		if ((eflags & REG_NOTBOL)
+		 || strncmp(line, sed_cmd->sub_literal, sed_cmd->sub_literal_len) != 0
+		) {
+			return REG_NOMATCH;
+		}
+		p = line;
+	} else {
+		/* pattern space is NUL terminated: strstr is memmem without strlen */
+		p = strstr(line, sed_cmd->sub_literal);
+		if (!p)
+			return REG_NOMATCH;
+	}
+	G.regmatch[0].rm_so = p - line;
+	G.regmatch[0].rm_eo = G.regmatch[0].rm_so + sed_cmd->sub_literal_len;
+	/* no subexpressions: "\1" in replacement expands to nothing */
+	for (i = 1; i < 10; i++)
+		G.regmatch[i].rm_so = G.regmatch[i].rm_eo = -1;
+	return 0;
+}
+
 static int do_subst_command(sed_cmd_t *sed_cmd, char **line_p)
 {
 	char *line = *line_p;
@@ -736,6 +835,8 @@ static int do_subst_command(sed_cmd_t *sed_cmd, char **line_p)
 	bool prev_match_empty = 1;
 	bool tried_at_eol = 0;
 	regex_t *current_regex;
+	char *old_buf;
+	int rest;
 
 	current_regex = sed_cmd->sub_match;
 	/* Handle empty regex. */
@@ -748,22 +849,19 @@ static int do_subst_command(sed_cmd_t *sed_cmd, char **line_p)
 
 	/* Find the first match */
 	dbg("matching '%s'", line);
-	if (REG_NOMATCH == regexec(current_regex, line, 10, G.regmatch, 0)) {
+	if (REG_NOMATCH == subst_exec(sed_cmd, current_regex, line, 0)) {
 		dbg("no match");
 		return 0;
 	}
 	dbg("match");
 
-	/* Initialize temporary output buffer. */
-	G.pipeline.buf = xmalloc(PIPE_GROW);
-	G.pipeline.len = PIPE_GROW;
+	/* Reset temporary output buffer. */
 	G.pipeline.idx = 0;
 
 	/* Now loop through, substituting for matches */
 	do {
 		int start = G.regmatch[0].rm_so;
 		int end = G.regmatch[0].rm_eo;
-		int i;
 
 		match_count++;
 
@@ -772,8 +870,8 @@ static int do_subst_command(sed_cmd_t *sed_cmd, char **line_p)
 		if (sed_cmd->which_match
 		 && (sed_cmd->which_match != match_count)
 		) {
-			for (i = 0; i < end; i++)
-				pipe_putc(*line++);
+			pipe_puts(line, end);
+			line += end;
 			/* Null match? Print one more char */
 			if (start == end && *line)
 				pipe_putc(*line++);
@@ -781,8 +879,7 @@ static int do_subst_command(sed_cmd_t *sed_cmd, char **line_p)
 		}
 
 		/* Print everything before the match */
-		for (i = 0; i < start; i++)
-			pipe_putc(line[i]);
+		pipe_puts(line, start);
 
 		/* Then print the substitution string,
 		 * unless we just matched empty string after non-empty one.
@@ -794,7 +891,10 @@ static int do_subst_command(sed_cmd_t *sed_cmd, char **line_p)
 		if (prev_match_empty || start != 0 || start != end) {
 			//dbg("%d %d %d", prev_match_empty, start, end);
 			dbg("inserting replacement at %d in '%s'", start, line);
-			do_subst_w_backrefs(line, sed_cmd->string);
+			if (sed_cmd->sub_plain)
+				pipe_puts(sed_cmd->string, strlen(sed_cmd->string));
+			else
+				do_subst_w_backrefs(line, sed_cmd->string);
 			/* Flag that something has changed */
 			altered = 1;
 		} else {
@@ -830,18 +930,20 @@ static int do_subst_command(sed_cmd_t *sed_cmd, char **line_p)
 		}
 
 //maybe (end ? REG_NOTBOL : 0) instead of unconditional REG_NOTBOL?
-	} while (regexec(current_regex, line, 10, G.regmatch, REG_NOTBOL) != REG_NOMATCH);
+	} while (subst_exec(sed_cmd, current_regex, line, REG_NOTBOL) != REG_NOMATCH);
 
-	/* Copy rest of string into output pipeline */
-	while (1) {
-		char c = *line++;
-		pipe_putc(c);
-		if (c == '\0')
-			break;
-	}
+	/* Copy rest of string (with its NUL) into output pipeline */
+	rest = strlen(line) + 1;
+	pipe_puts(line, rest);
 
-	free(*line_p);
+	/* The result becomes the pattern space; the old pattern space
+	 * (which is at least as big as its string) becomes the next
+	 * output buffer, so steady state substitution does not malloc.
+	 */
+	old_buf = *line_p;
 	*line_p = G.pipeline.buf;
+	G.pipeline.buf = old_buf;
+	G.pipeline.len = (line + rest) - old_buf;
 	return altered;
 }
 
@@ -1412,12 +1514,69 @@ static void add_cmd_block(char *cmdstr)
 	free(sv);
 }
 
+/* -i: edit one file through a temporary file, then rename it over */
+static void edit_in_place(const char *fname, const char *suffix)
+{
+	struct stat statbuf;
+	int nonstdoutfd;
+	sed_cmd_t *sed_cmd;
+
+	G.outname = xasprintf("%sXXXXXX", fname);
+	nonstdoutfd = xmkstemp(G.outname);
+	G.nonstdout = xfdopen_for_write(nonstdoutfd);
+
+	/* Set permissions/owner of output file */
+	stat(fname, &statbuf);
+	/* chmod'ing AFTER chown would preserve suid/sgid bits,
+	 * but GNU sed 4.2.1 does not preserve them either */
+	fchmod(nonstdoutfd, statbuf.st_mode);
+	fchown(nonstdoutfd, statbuf.st_uid, statbuf.st_gid);
+
+	process_files();
+	fclose(G.nonstdout);
+	G.nonstdout = stdout;
+
+	if (suffix) {
+		char *backupname = xasprintf("%s%s", fname, suffix);
+		xrename(fname, backupname);
+		free(backupname);
+	}
+	/* else unlink(fname); - rename below does this */
+	xrename(G.outname, fname); //TODO: rollback backup on error?
+	free(G.outname);
+	G.outname = NULL;
+
+	/* Re-enable disabled range matches. A range does not
+	 * span files (GNU sed -i does the same): -j workers could
+	 * not carry it from one file into the next anyway */
+	for (sed_cmd = G.sed_cmd_head; sed_cmd; sed_cmd = sed_cmd->next) {
+		sed_cmd->beg_line = sed_cmd->beg_line_orig;
+		sed_cmd->in_match = 0;
+	}
+}
+
+#if ENABLE_FEATURE_SED_PARALLEL
+/* Reap one -j worker. A worker which failed fails the whole run,
+ * it has already reported what went wrong. */
+static void wait_for_worker(void)
+{
+	int status;
+
+	if (safe_waitpid(-1, &status, 0) > 0 && status != 0)
+		G.exitcode = EXIT_FAILURE;
+}
+#endif
+
 int sed_main(int argc, char **argv) MAIN_EXTERNALLY_VISIBLE;
 int sed_main(int argc UNUSED_PARAM, char **argv)
 {
 	unsigned opt;
 	llist_t *opt_e, *opt_f;
 	char *opt_i;
+#if ENABLE_FEATURE_SED_PARALLEL
+	unsigned opt_j = 1;
+	unsigned workers = 0;
+#endif
 
 #if ENABLE_LONG_OPTS
 	static const char sed_longopts[] ALIGN1 =
@@ -1445,7 +1604,8 @@ int sed_main(int argc UNUSED_PARAM, char **argv)
 	opt_e = opt_f = NULL;
 	opt_i = NULL;
 	opt_complementary = "e::f::" /* can occur multiple times */
-	                    "nn"; /* count -n */
+	                    "nn" /* count -n */
+	                    IF_FEATURE_SED_PARALLEL(":j+"); /* -j N */
 
 	IF_LONG_OPTS(applet_long_options = sed_longopts);
 
@@ -1454,8 +1614,10 @@ int sed_main(int argc UNUSED_PARAM, char **argv)
 	 * GNU sed 4.2.1 mentions it in neither --help
 	 * nor manpage, but does recognize it.
 	 */
-	opt = getopt32(argv, "i::rEne:f:", &opt_i, &opt_e, &opt_f,
-			    &G.be_quiet); /* counter for -n */
+	opt = getopt32(argv, "i::rEne:f:" IF_FEATURE_SED_PARALLEL("j:"),
+			&opt_i, &opt_e, &opt_f,
+			IF_FEATURE_SED_PARALLEL(&opt_j,)
+			&G.be_quiet); /* counter for -n */
 	//argc -= optind;
 	argv += optind;
 	if (opt & OPT_in_place) { // -i
@@ -1503,10 +1665,6 @@ int sed_main(int argc UNUSED_PARAM, char **argv)
 		goto start;
 
 		for (; *argv; argv++) {
-			struct stat statbuf;
-			int nonstdoutfd;
-			sed_cmd_t *sed_cmd;
-
 			G.last_input_file++;
  start:
 			if (!(opt & OPT_in_place)) {
@@ -1518,37 +1676,33 @@ int sed_main(int argc UNUSED_PARAM, char **argv)
 			}
 
 			/* -i: process each FILE separately: */
-
-			G.outname = xasprintf("%sXXXXXX", *argv);
-			nonstdoutfd = xmkstemp(G.outname);
-			G.nonstdout = xfdopen_for_write(nonstdoutfd);
-
-			/* Set permissions/owner of output file */
-			stat(*argv, &statbuf);
-			/* chmod'ing AFTER chown would preserve suid/sgid bits,
-			 * but GNU sed 4.2.1 does not preserve them either */
-			fchmod(nonstdoutfd, statbuf.st_mode);
-			fchown(nonstdoutfd, statbuf.st_uid, statbuf.st_gid);
-
-			process_files();
-			fclose(G.nonstdout);
-			G.nonstdout = stdout;
-
-			if (opt_i) {
-				char *backupname = xasprintf("%s%s", *argv, opt_i);
-				xrename(*argv, backupname);
-				free(backupname);
-			}
-			/* else unlink(*argv); - rename below does this */
-			xrename(G.outname, *argv); //TODO: rollback backup on error?
-			free(G.outname);
-			G.outname = NULL;
-
-			/* Re-enable disabled range matches */
-			for (sed_cmd = G.sed_cmd_head; sed_cmd; sed_cmd = sed_cmd->next) {
-				sed_cmd->beg_line = sed_cmd->beg_line_orig;
+#if ENABLE_FEATURE_SED_PARALLEL
+			if (opt_j > 1) {
+				/* Each worker edits one file with its own copy
+				 * of the command list, pattern and hold space */
+				if (workers == opt_j) {
+					wait_for_worker();
+					workers--;
+				}
+				fflush_all();
+				if (xfork() == 0) {
+					edit_in_place(*argv, opt_i);
+					fflush_stdout_and_exit(G.exitcode);
+				}
+				workers++;
+				/* As if we processed it ourself */
+				G.current_input_file = G.last_input_file + 1;
+				continue;
 			}
+#endif
+			edit_in_place(*argv, opt_i);
+		}
+#if ENABLE_FEATURE_SED_PARALLEL
+		while (workers) {
+			wait_for_worker();
+			workers--;
 		}
+#endif
 		/* Here, to handle "sed 'cmds' nonexistent_file" case we did:
 		 * if (G.current_input_file[G.current_input_file] == NULL)
 		 *	return G.exitcode;
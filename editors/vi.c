@@ -250,6 +250,9 @@ struct globals {
 	char *text, *end;       // pointers to the user data in memory
 	char *dot;              // where all the action takes place
 	int text_size;		// size of the allocated buffer
+	char *gap;              // while inserting: text[] from "gap" up
+	int gap_size;           // to "end" is stored gap_size bytes later,
+	int gap_lines;          // it has this many NLs
 
 	/* the rest */
 	smallint vi_setops;
@@ -351,6 +354,9 @@ struct globals {
 #define G (*ptr_to_globals)
 #define text           (G.text          )
 #define text_size      (G.text_size     )
+#define gap            (G.gap           )
+#define gap_size       (G.gap_size      )
+#define gap_lines      (G.gap_lines     )
 #define end            (G.end           )
 #define dot            (G.dot           )
 #define reg            (G.reg           )
@@ -441,6 +447,7 @@ static void dot_delete(void);	// delete the char at 'dot'
 static char *bound_dot(char *);	// make sure  text[0] <= P < "end"
 static char *new_screen(int, int);	// malloc virtual screen memory
 static char *char_insert(char *, char);	// insert the char c at 'p'
+static char *pending_insert(char *, int);	// insert c and typed-ahead chars at 'p'
 // might reallocate text[]! use p += stupid_insert(p, ...),
 // and be careful to not use pointers into potentially freed text[]!
 static uintptr_t stupid_insert(char *, char);	// stupidly insert the char c at 'p'
@@ -452,6 +459,9 @@ static char *text_hole_delete(char *, char *);	// at "p", delete a 'size' byte h
 // might reallocate text[]! use p += text_hole_make(p, ...),
 // and be careful to not use pointers into potentially freed text[]!
 static uintptr_t text_hole_make(char *, int);	// at "p", make a 'size' byte hole
+static int text_gap_open(char *, int);	// move the rest of text[] away from "p"
+static void text_gap_close(void);	// make text[] contiguous again
+static int lines_before_gap(char *);	// can refresh() show the lines from "p"?
 static char *yank_delete(char *, char *, int, int);	// yank text[] into register then delete
 static void show_help(void);	// display some help info
 static void rawmode(void);	// set "raw" mode on tty
@@ -622,6 +632,7 @@ static int init_text_buffer(char *fn)
 
 	/* allocate/reallocate text buffer */
 	free(text);
+	gap = NULL;
 	text_size = size + 10240;
 	screenbegin = dot = end = text = xzalloc(text_size);
 
@@ -1876,6 +1887,67 @@ static uintptr_t stupid_insert(char *p, char c) // stupidly insert the char c at
 	return bias;
 }
 
+// can c go into text[] as is, without char_insert() special handling?
+static int is_plain_insert(int c)
+{
+	if (c == 13 || c == '\n') {
+#if ENABLE_FEATURE_VI_SETOPTS
+		if (autoindent)
+			return 0;
+#endif
+		return 1;
+	}
+	if (c != '\t' && (c < ' ' || c == 127 || c == (unsigned char)erase_char))
+		return 0;
+#if ENABLE_FEATURE_VI_SETOPTS
+	if (showmatch && strchr(")]}", c) != NULL)
+		return 0;
+#endif
+	return 1;
+}
+
+// return next input char without consuming it, or -1 if none is waiting
+static int peek_one_char(void)
+{
+#if ENABLE_FEATURE_VI_DOT_CMD
+	if (!adding2q && ioq)
+		return *ioq ? (unsigned char)*ioq : -1;
+#endif
+	// readbuffer[0] is read_key()'s count of buffered chars
+	if (readbuffer[0] == 0) {
+		if (mysleep(0) == 0 || safe_read(STDIN_FILENO, readbuffer + 1, 1) != 1)
+			return -1;
+		readbuffer[0] = 1;
+	}
+	return (unsigned char)readbuffer[1];
+}
+
+// A paste arrives as many chars at once. Insert all plain chars
+// which are already waiting with one text_hole_make(), instead of
+// moving everything after 'p' once per char.
+// might reallocate text[]!
+static char *pending_insert(char *p, int c)
+{
+	char buf[256];
+	int n;
+
+	if (!is_plain_insert(c))
+		return char_insert(p, c);
+	n = 0;
+	for (;;) {
+		buf[n++] = (c == 13) ? '\n' : c;	// translate \r to \n
+		if (n == sizeof(buf))
+			break;
+		c = peek_one_char();
+		if (c < 0 || !is_plain_insert(c))
+			break;
+		get_one_char();	// consume it (and add to the "." q)
+	}
+	p += text_hole_make(p, n);
+	memcpy(p, buf, n);
+	return p + n;
+}
+
 static int find_range(char **start, char **stop, char c)
 {
 	char *save_dot, *p, *q, *t;
@@ -2053,6 +2125,66 @@ static void showmatching(char *p)
 }
 #endif /* FEATURE_VI_SETOPTS */
 
+// Typing near the top of a big file used to move all of the text
+// below the cursor once per char. In insert mode, text[] is split
+// instead: the text from "gap" (the start of a line a couple of
+// screens below "p") to "end" is moved up by all the free space,
+// and inserts and deletes before "gap" only move the lines between
+// "p" and "gap". "end" and all other pointers keep their values.
+// Only refresh() and the insert mode path may run while text[] is
+// split; every command must text_gap_close() first.
+// Called by text_hole_make() after it has added 'size' to "end".
+static int text_gap_open(char *p, int size)
+{
+	char *old_end = end - size;
+	char *q = p;
+	int cnt;
+
+	if (cmd_mode == 0 || old_end - p < 64 * 1024)
+		return 0;	// moving the rest is cheap enough
+	for (cnt = 0; cnt < 2 * rows; cnt++) {
+		q = memchr(q, '\n', old_end - q);
+		if (!q)
+			return 0;
+		q++;
+	}
+	if (q >= old_end)
+		return 0;
+	gap = q;
+	gap_size = text + text_size - old_end;
+	// format_edit_status() can not count these while text[] is split
+	gap_lines = 0;
+	while ((q = memchr(q, '\n', old_end - q)) != NULL) {
+		gap_lines++;
+		q++;
+	}
+	memmove(gap + gap_size, gap, old_end - gap);
+	return 1;
+}
+
+static void text_gap_close(void)
+{
+	if (gap) {
+		memmove(gap, gap + gap_size, end - gap);
+		gap = NULL;
+	}
+}
+
+// refresh() reads whole lines from screenbegin and from dot on:
+// they must end before the gap
+static int lines_before_gap(char *p)
+{
+	int cnt;
+
+	for (cnt = 0; cnt < rows; cnt++) {
+		if (p >= gap)
+			return 0;
+		// gap[-1] is a NL, we always find one
+		p = (char *)memchr(p, '\n', gap - p) + 1;
+	}
+	return 1;
+}
+
 // open a hole in text[]
 // might reallocate text[]! use p += text_hole_make(p, ...),
 // and be careful to not use pointers into potentially freed text[]!
@@ -2062,10 +2194,13 @@ static uintptr_t text_hole_make(char *p, int size)	// at "p", make a 'size' byte
 
 	if (size <= 0)
 		return bias;
+	if (gap && (p >= gap || size >= gap_size))
+		text_gap_close();	// it is not where we need it, or too small
 	end += size;		// adjust the new END
 	if (end >= (text + text_size)) {
 		char *new_text;
-		text_size += end - (text + text_size) + 10240;
+		// extra 1/8: for a big file, 10k is used up by a few pastes
+		text_size += end - (text + text_size) + 10240 + text_size / 8;
 		new_text = xrealloc(text, text_size);
 		bias = (new_text - text);
 		screenbegin += bias;
@@ -2082,8 +2217,15 @@ static uintptr_t text_hole_make(char *p, int size)	// at "p", make a 'size' byte
 #endif
 		text = new_text;
 	}
-	memmove(p + size, p, end - size - p);
-	memset(p, ' ', size);	// clear new hole
+	if (gap || text_gap_open(p, size)) {
+		// only the text up to the gap moves
+		memmove(p + size, p, gap - p);
+		gap += size;
+		gap_size -= size;
+	} else {
+		memmove(p + size, p, end - size - p);
+	}
+	// no need to clear new hole, all callers fill it
 	file_modified++;
 	return bias;
 }
@@ -2108,6 +2250,16 @@ static char *text_hole_delete(char *p, char *q) // delete "p" through "q", inclu
 		goto thd0;
 	if (dest < text || dest >= end)
 		goto thd0;
+	if (gap) {
+		if (src < gap) {
+			// only the text up to the gap moves
+			cnt = gap - src;
+			gap -= hole_size;
+			gap_size += hole_size;
+		} else {
+			text_gap_close();
+		}
+	}
 	if (src >= end)
 		goto thd_atend;	// just delete the end of the buffer
 	memmove(dest, src, cnt);
@@ -2797,7 +2949,10 @@ static int format_edit_status(void)
 	// reduce counting -- the total lines can't have
 	// changed if we haven't done any edits.
 	if (file_modified != last_file_modified) {
-		tot = cur + count_lines(dot, end - 1) - 1;
+		if (gap)	// the lines after it were counted when it opened
+			tot = cur + count_lines(dot, gap - 1) + gap_lines - 1;
+		else
+			tot = cur + count_lines(dot, end - 1) - 1;
 		last_file_modified = file_modified;
 	}
 
@@ -2921,6 +3076,8 @@ static void refresh(int full_screen)
 		query_screen_dimensions();
 		full_screen |= (c - columns) | (r - rows);
 	}
+	if (gap && !(lines_before_gap(screenbegin) && lines_before_gap(begin_line(dot))))
+		text_gap_close();
 	sync_cursor(dot, &crow, &ccol);	// where cursor will be (on "dot")
 	tp = screenbegin;	// index into text[] of top line
 
@@ -3062,14 +3219,16 @@ static void do_cmd(int c)
 	if (cmd_mode == 1) {
 		//  hitting "Insert" twice means "R" replace mode
 		if (c == KEYCODE_INSERT) goto dc5;
-		// insert the char c at "dot"
+		// insert the char c (and typed-ahead ones) at "dot"
 		if (1 <= c || Isprint(c)) {
-			dot = char_insert(dot, c);
+			dot = pending_insert(dot, c);
 		}
 		goto dc1;
 	}
 
  key_cmd_mode:
+	// commands may look at all of text[]
+	text_gap_close();
 	switch (c) {
 		//case 0x01:	// soh
 		//case 0x09:	// ht
@@ -399,7 +399,7 @@ struct globals {
 	memset(&G, 0, sizeof(G)); \
 	IF_FEATURE_FIND_MAXDEPTH(G.minmaxdepth[1] = INT_MAX;) \
 	G.need_print = 1; \
-	G.recurse_flags = ACTION_RECURSE; \
+	G.recurse_flags = ACTION_RECURSE | ACTION_OPENAT; \
 } while (0)
 
 #if ENABLE_FEATURE_FIND_EXEC
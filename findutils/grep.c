@@ -664,7 +664,8 @@ static int grep_dir(const char *dir)
 	recursive_action(dir,
 		/* recurse=yes */ ACTION_RECURSE |
 		/* followLinks=no */
-		/* depthFirst=yes */ ACTION_DEPTHFIRST,
+		/* depthFirst=yes */ ACTION_DEPTHFIRST |
+		/* fileAction doesn't use statbuf */ ACTION_OPENAT | ACTION_TYPE_ONLY,
 		/* fileAction= */ file_action_grep,
 		/* dirAction= */ NULL,
 		/* userData= */ &matched,
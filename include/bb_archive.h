@@ -28,12 +28,27 @@ enum {
 #endif
 };
 
+#if ENABLE_FEATURE_TAR_SPARSE
+/* Data regions of a GNU sparse file, the rest are holes */
+typedef struct tar_sparse_t {
+	off_t realsize;
+	unsigned count;
+	struct tar_sparse_entry_t {
+		off_t offset;
+		off_t numbytes;
+	} map[1];
+} tar_sparse_t;
+#endif
+
 typedef struct file_header_t {
 	char *name;
 	char *link_target;
 #if ENABLE_FEATURE_TAR_UNAME_GNAME
 	char *tar__uname;
 	char *tar__gname;
+#endif
+#if ENABLE_FEATURE_TAR_SPARSE
+	tar_sparse_t *tar__sparse; /* NULL if not a sparse member */
 #endif
 	off_t size;
 	uid_t uid;
@@ -125,6 +140,9 @@ typedef struct archive_handle_t {
 #if ENABLE_RPM
 #define ARCHIVE_REPLACE_VIA_RENAME  (1 << 10)
 #endif
+#if ENABLE_FEATURE_TAR_SPARSE
+#define ARCHIVE_STORE_SPARSE        (1 << 14)
+#endif
 #if ENABLE_FEATURE_TAR_SELINUX
 #define ARCHIVE_STORE_SELINUX		(1 << 15)
 #endif
@@ -161,6 +179,29 @@ struct BUG_tar_header {
 	char c[sizeof(tar_header_t) == TAR_BLOCK_SIZE ? 1 : -1];
 };
 
+/* GNU sparse member (typeflag 'S') keeps these in tar_header_t.prefix[] */
+typedef struct tar_sparse_header_t { /* byte offset */
+	char atime[12];           /* 345-356 */
+	char ctime[12];           /* 357-368 */
+	char offset[12];          /* 369-380 */
+	char longnames[4];        /* 381-384 */
+	char unused;              /* 385 */
+	char sp[4][2][12];        /* 386-481 (offset, numbytes) pairs */
+	char isextended;          /* 482 */
+	char realsize[12];        /* 483-494 */
+	char pad[5];              /* 495-499 */
+} tar_sparse_header_t;
+/* If isextended, header is followed by blocks of more pairs */
+typedef struct tar_sparse_ext_t {
+	char sp[21][2][12];
+	char isextended;
+	char pad[7];
+} tar_sparse_ext_t;
+struct BUG_tar_sparse_header {
+	char c1[sizeof(tar_sparse_header_t) == 155 ? 1 : -1];
+	char c2[sizeof(tar_sparse_ext_t) == TAR_BLOCK_SIZE ? 1 : -1];
+};
+
 
 
 archive_handle_t *init_handle(void) FAST_FUNC;
@@ -176,6 +217,8 @@ void data_skip(archive_handle_t *archive_handle) FAST_FUNC;
 void data_extract_all(archive_handle_t *archive_handle) FAST_FUNC;
 void data_extract_to_stdout(archive_handle_t *archive_handle) FAST_FUNC;
 void data_extract_to_command(archive_handle_t *archive_handle) FAST_FUNC;
+/* Unpack data of a GNU sparse member, recreating its holes */
+void data_copy_sparse(archive_handle_t *archive_handle, int dst_fd, int ignore_write_err) FAST_FUNC;
 
 void header_skip(const file_header_t *file_header) FAST_FUNC;
 void header_list(const file_header_t *file_header) FAST_FUNC;
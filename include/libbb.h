@@ -358,6 +358,10 @@ enum {	/* DO NOT CHANGE THESE VALUES!  cp.c, mv.c, install.c depend on them. */
 	FILEUTILS_SET_SECURITY_CONTEXT = 1 << 10,
 #endif
 	FILEUTILS_IGNORE_CHMOD_ERR = 1 << 11,
+	FILEUTILS_REFLINK         = 1 << 12, /* --reflink[=auto] */
+	FILEUTILS_REFLINK_ALWAYS  = 1 << 13, /* --reflink=always */
+	FILEUTILS_SPARSE          = 1 << 14, /* --sparse=auto */
+	FILEUTILS_SPARSE_ALWAYS   = 1 << 15, /* --sparse=always */
 };
 #define FILEUTILS_CP_OPTSTR "pdRfilsLH" IF_SELINUX("c")
 extern int remove_file(const char *path, int flags) FAST_FUNC;
@@ -366,6 +370,11 @@ extern int remove_file(const char *path, int flags) FAST_FUNC;
  * This makes "cp /dev/null file" and "install /dev/null file" (!!!)
  * work coreutils-compatibly. */
 extern int copy_file(const char *source, const char *dest, int flags) FAST_FUNC;
+/* cp -j N: copy_file() hands data of big regular files to up to N
+ * child processes. copy_file_wait_jobs() waits for all of them,
+ * returns -1 if any failed */
+void copy_file_set_jobs(unsigned n) FAST_FUNC;
+int copy_file_wait_jobs(void) FAST_FUNC;
 
 enum {
 	ACTION_RECURSE        = (1 << 0),
@@ -375,8 +384,10 @@ enum {
 	/*ACTION_REVERSE      = (1 << 4), - unused */
 	ACTION_QUIET          = (1 << 5),
 	ACTION_DANGLING_OK    = (1 << 6),
+	ACTION_OPENAT         = (1 << 7), /* stat/open entries relative to parent dir fd */
+	ACTION_TYPE_ONLY      = (1 << 8), /* actions use only S_IFMT of statbuf, ok to take it from d_type */
 };
-typedef uint8_t recurse_flags_t;
+typedef uint16_t recurse_flags_t;
 extern int recursive_action(const char *fileName, unsigned flags,
 	int FAST_FUNC (*fileAction)(const char *fileName, struct stat* statbuf, void* userData, int depth),
 	int FAST_FUNC (*dirAction)(const char *fileName, struct stat* statbuf, void* userData, int depth),
@@ -391,6 +402,10 @@ extern char *find_block_device(const char *path) FAST_FUNC;
 extern off_t bb_copyfd_eof(int fd1, int fd2) FAST_FUNC;
 extern off_t bb_copyfd_size(int fd1, int fd2, off_t size) FAST_FUNC;
 extern void bb_copyfd_exact_size(int fd1, int fd2, off_t size) FAST_FUNC;
+/* Like bb_copyfd_eof, but recreates holes of fd1 in fd2 (a regular file).
+ * zeros != 0: also makes holes of all-zero blocks */
+extern off_t bb_copyfd_sparse(int fd1, int fd2, int zeros) FAST_FUNC;
+extern int is_zero_block(const void *buf, size_t len) FAST_FUNC;
 /* "short" copy can be detected by return value < size */
 /* this helper yells "short read!" if param is not -1 */
 extern void complain_copyfd_and_die(off_t sz) NORETURN FAST_FUNC;
@@ -8,6 +8,12 @@
  * Licensed under GPLv2 or later, see file LICENSE in this source tree.
  */
 #include "libbb.h"
+#if ENABLE_FEATURE_CP_REFLINK
+# include <sys/ioctl.h>
+# ifndef FICLONE
+#  define FICLONE _IOW(0x94, 9, int)
+# endif
+#endif
 
 // FEATURE_NON_POSIX_CP:
 //
@@ -67,6 +73,75 @@ static int ask_and_unlink(const char *dest, int flags)
 	return 1; /* ok (to try again) */
 }
 
+#if ENABLE_FEATURE_CP_PARALLEL
+/* Only data of big regular files is copied by jobs. Everything else
+ * (mkdir, links, prompts, creating dest) is done by the parent, in order.
+ * A job touches only the file it got already open, and only via its fd:
+ * the parent may already have given the directory its preserved mode,
+ * "cp -a" of a 0444 dir as non-root can't reach dest by name anymore.
+ */
+enum { JOB_MIN_SIZE = 256 * 1024 };
+
+static struct copy_jobs {
+	unsigned max;
+	unsigned running;
+	smallint failed;
+} copy_jobs;
+
+void FAST_FUNC copy_file_set_jobs(unsigned n)
+{
+	copy_jobs.max = n;
+}
+
+static void wait_one_job(void)
+{
+	int status;
+
+	if (safe_waitpid(-1, &status, 0) > 0 && status != 0)
+		copy_jobs.failed = 1;
+	copy_jobs.running--;
+}
+
+/* Like preserve_mode_ugid_time: in copy_file(), but by fd */
+static void job_preserve_status(int fd, const char *dest, struct stat *st)
+{
+	struct timespec times[2];
+
+	times[1].tv_sec = times[0].tv_sec = st->st_mtime;
+	times[1].tv_nsec = times[0].tv_nsec = 0;
+	if (futimens(fd, times) < 0)
+		bb_perror_msg("can't preserve %s of '%s'", "times", dest);
+	if (fchown(fd, st->st_uid, st->st_gid) < 0) {
+		st->st_mode &= ~(S_ISUID | S_ISGID);
+		bb_perror_msg("can't preserve %s of '%s'", "ownership", dest);
+	}
+	if (fchmod(fd, st->st_mode) < 0)
+		bb_perror_msg("can't preserve %s of '%s'", "permissions", dest);
+}
+
+int FAST_FUNC copy_file_wait_jobs(void)
+{
+	while (copy_jobs.running)
+		wait_one_job();
+	return copy_jobs.failed ? -1 : 0;
+}
+
+/* Return: pid in parent, 0 in the job, -1: copy it yourself */
+static pid_t start_job(void)
+{
+	pid_t pid;
+
+	if (copy_jobs.max <= 1)
+		return -1;
+	if (copy_jobs.running >= copy_jobs.max)
+		wait_one_job();
+	pid = fork();
+	if (pid > 0)
+		copy_jobs.running++;
+	return pid;
+}
+#endif
+
 /* Return:
  * -1 error, copy not made
  *  0 copy is made or user answered "no" in interactive mode
@@ -81,6 +156,7 @@ int FAST_FUNC copy_file(const char *source, const char *dest, int flags)
 	smallint retval = 0;
 	smallint dest_exists = 0;
 	smallint ovr;
+	IF_FEATURE_CP_PARALLEL(smallint in_job = 0;)
 
 /* Inverse of cp -d ("cp without -d") */
 #define FLAGS_DEREF (flags & (FILEUTILS_DEREFERENCE + FILEUTILS_DEREFERENCE_L0))
@@ -314,8 +390,50 @@ int FAST_FUNC copy_file(const char *source, const char *dest, int flags)
 			}
 		}
 #endif
+#if ENABLE_FEATURE_CP_REFLINK
+		if ((flags & FILEUTILS_REFLINK) && S_ISREG(source_stat.st_mode)) {
+			/* Share data blocks with the source (btrfs, xfs) */
+			if (ioctl(dst_fd, FICLONE, src_fd) == 0)
+				goto close_dst;
+			if (flags & FILEUTILS_REFLINK_ALWAYS) {
+				bb_perror_msg("can't clone '%s'", source);
+				retval = -1;
+				goto close_dst;
+			}
+		}
+#endif
+#if ENABLE_FEATURE_CP_PARALLEL
+		if (S_ISREG(source_stat.st_mode) && source_stat.st_size >= JOB_MIN_SIZE) {
+			pid_t pid = start_job();
+			if (pid > 0) {
+				/* The job copies data and preserves mode/owner/times */
+				close(dst_fd);
+				close(src_fd);
+				return 0;
+			}
+			in_job = (pid == 0);
+		}
+#endif
+		if ((flags & FILEUTILS_SPARSE)
+		 && S_ISREG(source_stat.st_mode)
+		 /* Does source have holes? (--sparse=always: or zeros) */
+		 && ((flags & FILEUTILS_SPARSE_ALWAYS)
+		    || source_stat.st_blocks < source_stat.st_size / 512)
+		 && fstat(dst_fd, &dest_stat) == 0
+		 && S_ISREG(dest_stat.st_mode)
+		) {
+			if (bb_copyfd_sparse(src_fd, dst_fd, flags & FILEUTILS_SPARSE_ALWAYS) == -1)
+				retval = -1;
+		} else
 		if (bb_copyfd_eof(src_fd, dst_fd) == -1)
 			retval = -1;
+#if ENABLE_FEATURE_CP_REFLINK
+ close_dst:
+#endif
+#if ENABLE_FEATURE_CP_PARALLEL
+		if (in_job && (flags & FILEUTILS_PRESERVE_STATUS))
+			job_preserve_status(dst_fd, dest, &source_stat);
+#endif
 		/* Careful with writing... */
 		if (close(dst_fd) < 0) {
 			bb_perror_msg("error writing to '%s'", dest);
@@ -323,6 +441,10 @@ int FAST_FUNC copy_file(const char *source, const char *dest, int flags)
 		}
 		/* ...but read size is already checked by bb_copyfd_eof */
 		close(src_fd);
+#if ENABLE_FEATURE_CP_PARALLEL
+		if (in_job)
+			_exit(retval < 0);
+#endif
 		/* "cp /dev/something new_file" should not
 		 * copy mode of /dev/something */
 		if (!S_ISREG(source_stat.st_mode))
@@ -133,3 +133,124 @@ off_t FAST_FUNC bb_copyfd_eof(int fd1, int fd2)
 {
 	return bb_full_fd_action(fd1, fd2, 0);
 }
+
+int FAST_FUNC is_zero_block(const void *buf, size_t len)
+{
+	const char *p = buf;
+
+	/* Each byte equals the next one, and the first one is 0 */
+	return len == 0 || (p[0] == 0 && memcmp(p, p + 1, len - 1) == 0);
+}
+
+#ifdef SEEK_HOLE
+enum { SPARSE_BUFSIZE = 64 * 1024, SPARSE_BLKSIZE = 4 * 1024 };
+
+/* Copy len bytes, seeking over all-zero 4k blocks in dst_fd.
+ * Returns bytes consumed from src_fd, or -1 */
+static off_t copy_seek_zeros(int src_fd, int dst_fd, off_t len, char *buf)
+{
+	off_t total = 0;
+
+	while (total < len) {
+		ssize_t rd, i;
+
+		rd = safe_read(src_fd, buf, len - total > SPARSE_BUFSIZE ? SPARSE_BUFSIZE : len - total);
+		if (rd <= 0) {
+			if (rd < 0) {
+				bb_perror_msg(bb_msg_read_error);
+				return -1;
+			}
+			break;
+		}
+		for (i = 0; i < rd; i += SPARSE_BLKSIZE) {
+			ssize_t n = rd - i > SPARSE_BLKSIZE ? SPARSE_BLKSIZE : rd - i;
+			if (is_zero_block(buf + i, n)) {
+				if (lseek(dst_fd, n, SEEK_CUR) < 0)
+					goto write_err;
+			} else if (full_write(dst_fd, buf + i, n) != n) {
+ write_err:
+				bb_perror_msg(bb_msg_write_error);
+				return -1;
+			}
+		}
+		total += rd;
+	}
+	return total;
+}
+
+/* Copy till EOF like bb_copyfd_eof, but do not read the holes of src_fd
+ * (found with SEEK_DATA/SEEK_HOLE), seek over them in dst_fd instead.
+ * If zeros != 0, all-zero blocks in data become holes too.
+ * dst_fd must be a regular file. Not for NOFORK applets: uses xmalloc.
+ */
+off_t FAST_FUNC bb_copyfd_sparse(int src_fd, int dst_fd, int zeros)
+{
+	struct stat st;
+	off_t start, dst_start, pos, end;
+	char *buf = NULL;
+
+	start = lseek(src_fd, 0, SEEK_CUR);
+	dst_start = lseek(dst_fd, 0, SEEK_CUR);
+	if (start < 0 || dst_start < 0 || fstat(src_fd, &st) != 0)
+		return bb_copyfd_eof(src_fd, dst_fd);
+	end = st.st_size;
+	if (zeros)
+		buf = xmalloc(SPARSE_BUFSIZE);
+
+	pos = start;
+	while (pos < end) {
+		off_t data, hole, got;
+
+		data = lseek(src_fd, pos, SEEK_DATA);
+		if (data < 0) {
+			if (errno != ENXIO) {
+				/* SEEK_DATA not supported? Copy what is left */
+				if (pos != start || lseek(src_fd, pos, SEEK_SET) < 0)
+					goto read_err;
+				free(buf);
+				return bb_copyfd_eof(src_fd, dst_fd);
+			}
+			/* Only a hole up to EOF is left */
+			pos = end;
+			break;
+		}
+		hole = lseek(src_fd, data, SEEK_HOLE);
+		if (hole < 0 || lseek(src_fd, data, SEEK_SET) < 0)
+			goto read_err;
+		if (lseek(dst_fd, dst_start + (data - start), SEEK_SET) < 0)
+			goto write_err;
+		if (zeros)
+			got = copy_seek_zeros(src_fd, dst_fd, hole - data, buf);
+		else
+			got = bb_copyfd_size(src_fd, dst_fd, hole - data);
+		if (got < 0)
+			goto err;
+		pos = data + got;
+		if (pos != hole) /* file shrank under us */
+			break;
+	}
+	free(buf);
+	/* Create the hole at the end, if any */
+	if (fstat(dst_fd, &st) == 0 && st.st_size < dst_start + (pos - start)
+	 && ftruncate(dst_fd, dst_start + (pos - start)) != 0
+	) {
+		bb_perror_msg(bb_msg_write_error);
+		return -1;
+	}
+	return pos - start;
+
+ write_err:
+	bb_perror_msg(bb_msg_write_error);
+	goto err;
+ read_err:
+	bb_perror_msg(bb_msg_read_error);
+ err:
+	free(buf);
+	return -1;
+}
+#else
+off_t FAST_FUNC bb_copyfd_sparse(int src_fd, int dst_fd, int zeros UNUSED_PARAM)
+{
+	return bb_copyfd_eof(src_fd, dst_fd);
+}
+#endif
@@ -10,18 +10,107 @@
 
 #include "libbb.h"
 
-typedef struct ino_dev_hash_bucket_struct {
-	struct ino_dev_hash_bucket_struct *next;
+#undef DEBUG_INODE_HASH
+
+/* Open addressing with linear probing. The table doubles
+ * when it is 3/4 full, entries are never removed one by one.
+ * Names are packed into large chunks instead of being malloced
+ * one by one: cp -a of a tree with a million hardlinks would
+ * otherwise do a million small mallocs.
+ */
+typedef struct ino_dev_entry {
 	ino_t ino;
 	dev_t dev;
-	char name[1];
-} ino_dev_hashtable_bucket_t;
+	char *name; /* NULL: free slot */
+} ino_dev_entry_t;
+
+typedef struct name_chunk {
+	struct name_chunk *next;
+	char buf[1];
+} name_chunk_t;
+
+#define INITIAL_SIZE   256   /* Must be a power of 2 */
+#define CHUNK_SIZE     (4 * 1024)
+
+static struct ino_dev_hashtable {
+	ino_dev_entry_t *tab;
+	unsigned mask;        /* table size - 1 */
+	unsigned count;
+	name_chunk_t *chunks;
+	char *name_ptr;
+	unsigned name_left;
+#ifdef DEBUG_INODE_HASH
+	unsigned long lookups;
+	unsigned long probes;
+	unsigned grows;
+#endif
+} ino_dev_hashtable;
+#define H ino_dev_hashtable
+
+static unsigned hash_ino_dev(ino_t ino, dev_t dev)
+{
+	/* Inode numbers are often sequential, multiplication
+	 * spreads them over all bits */
+	uint64_t h = ((uint64_t)ino + (uint64_t)dev * 0x9e3779b97f4a7c15ULL)
+			* 0x9e3779b97f4a7c15ULL;
+	return h ^ (h >> 32);
+}
+
+static ino_dev_entry_t *find_slot(ino_t ino, dev_t dev)
+{
+	unsigned i = hash_ino_dev(ino, dev) & H.mask;
+
+#ifdef DEBUG_INODE_HASH
+	H.lookups++;
+#endif
+	while (H.tab[i].name
+	 && (H.tab[i].ino != ino || H.tab[i].dev != dev)
+	) {
+#ifdef DEBUG_INODE_HASH
+		H.probes++;
+#endif
+		i = (i + 1) & H.mask;
+	}
+	return &H.tab[i];
+}
+
+static void grow_table(void)
+{
+	ino_dev_entry_t *old = H.tab;
+	unsigned old_size = old ? H.mask + 1 : 0;
+	unsigned i;
 
-#define HASH_SIZE      311   /* Should be prime */
-#define hash_inode(i)  ((i) % HASH_SIZE)
+	H.mask = old ? old_size * 2 - 1 : INITIAL_SIZE - 1;
+	H.tab = xzalloc((H.mask + 1) * sizeof(H.tab[0]));
+	for (i = 0; i < old_size; i++) {
+		if (old[i].name)
+			*find_slot(old[i].ino, old[i].dev) = old[i];
+	}
+	free(old);
+#ifdef DEBUG_INODE_HASH
+	H.grows++;
+#endif
+}
 
-/* array of [HASH_SIZE] elements */
-static ino_dev_hashtable_bucket_t **ino_dev_hashtable;
+static char *store_name(const char *name)
+{
+	unsigned len = strlen(name) + 1;
+	char *p;
+
+	if (len > H.name_left) {
+		unsigned size = len > CHUNK_SIZE ? len : CHUNK_SIZE;
+		name_chunk_t *chunk = xmalloc(sizeof(*chunk) + size);
+		chunk->next = H.chunks;
+		H.chunks = chunk;
+		H.name_ptr = chunk->buf;
+		H.name_left = size;
+	}
+	p = H.name_ptr;
+	memcpy(p, name, len);
+	H.name_ptr += len;
+	H.name_left -= len;
+	return p;
+}
 
 /*
  * Return name if statbuf->st_ino && statbuf->st_dev are recorded in
@@ -29,59 +118,47 @@ static ino_dev_hashtable_bucket_t **ino_dev_hashtable;
  */
 char* FAST_FUNC is_in_ino_dev_hashtable(const struct stat *statbuf)
 {
-	ino_dev_hashtable_bucket_t *bucket;
-
-	if (!ino_dev_hashtable)
+	if (!H.tab)
 		return NULL;
 
-	bucket = ino_dev_hashtable[hash_inode(statbuf->st_ino)];
-	while (bucket != NULL) {
-		if ((bucket->ino == statbuf->st_ino)
-		 && (bucket->dev == statbuf->st_dev)
-		) {
-			return bucket->name;
-		}
-		bucket = bucket->next;
-	}
-	return NULL;
+	return find_slot(statbuf->st_ino, statbuf->st_dev)->name;
 }
 
 /* Add statbuf to statbuf hash table */
 void FAST_FUNC add_to_ino_dev_hashtable(const struct stat *statbuf, const char *name)
 {
-	int i;
-	ino_dev_hashtable_bucket_t *bucket;
-
-	i = hash_inode(statbuf->st_ino);
-	if (!name)
-		name = "";
-	bucket = xmalloc(sizeof(ino_dev_hashtable_bucket_t) + strlen(name));
-	bucket->ino = statbuf->st_ino;
-	bucket->dev = statbuf->st_dev;
-	strcpy(bucket->name, name);
-
-	if (!ino_dev_hashtable)
-		ino_dev_hashtable = xzalloc(HASH_SIZE * sizeof(*ino_dev_hashtable));
-
-	bucket->next = ino_dev_hashtable[i];
-	ino_dev_hashtable[i] = bucket;
+	ino_dev_entry_t *e;
+
+	if (!H.tab || (H.count + 1) * 4 > (H.mask + 1) * 3)
+		grow_table();
+
+	e = find_slot(statbuf->st_ino, statbuf->st_dev);
+	if (!e->name) {
+		e->ino = statbuf->st_ino;
+		e->dev = statbuf->st_dev;
+		H.count++;
+	}
+	/* Already there? The newest name wins */
+	e->name = store_name(name ? name : "");
 }
 
 #if ENABLE_DU || ENABLE_FEATURE_CLEAN_UP
 /* Clear statbuf hash table */
 void FAST_FUNC reset_ino_dev_hashtable(void)
 {
-	unsigned i;
-	ino_dev_hashtable_bucket_t *bucket;
-
-	for (i = 0; ino_dev_hashtable && i < HASH_SIZE; i++) {
-		while (ino_dev_hashtable[i] != NULL) {
-			bucket = ino_dev_hashtable[i]->next;
-			free(ino_dev_hashtable[i]);
-			ino_dev_hashtable[i] = bucket;
-		}
+	name_chunk_t *chunk;
+
+#ifdef DEBUG_INODE_HASH
+	bb_error_msg("ino/dev hash: %u entries, size %u, %u grows, "
+			"%lu lookups, %lu extra probes",
+			H.count, H.tab ? H.mask + 1 : 0, H.grows,
+			H.lookups, H.probes);
+#endif
+	while ((chunk = H.chunks) != NULL) {
+		H.chunks = chunk->next;
+		free(chunk);
 	}
-	free(ino_dev_hashtable);
-	ino_dev_hashtable = NULL;
+	free(H.tab);
+	memset(&H, 0, sizeof(H));
 }
 #endif
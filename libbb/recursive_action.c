@@ -51,9 +51,19 @@ static int FAST_FUNC true_action(const char *fileName UNUSED_PARAM,
  * ACTION_FOLLOWLINKS mainly controls handling of links to dirs.
  * 0: lstat(statbuf). Calls fileAction on link name even if points to dir.
  * 1: stat(statbuf). Calls dirAction and optionally recurse on link to dir.
+ *
+ * ACTION_OPENAT: stat and open directory entries relative to the fd
+ * of their parent directory, not by the full path. The kernel then
+ * looks up one name per entry instead of walking the whole path again.
+ * Actions still get the full path.
+ *
+ * ACTION_TYPE_ONLY: actions look only at the file type bits of
+ * statbuf->st_mode. Where readdir() reports the type (d_type),
+ * the entry is not stat'ed at all, and the rest of statbuf is zero.
  */
 
-int FAST_FUNC recursive_action(const char *fileName,
+static int recurse(const char *fileName,
+		int dir_fd, const char *name, unsigned d_type,
 		unsigned flags,
 		int FAST_FUNC (*fileAction)(const char *fileName, struct stat *statbuf, void* userData, int depth),
 		int FAST_FUNC (*dirAction)(const char *fileName, struct stat *statbuf, void* userData, int depth),
@@ -66,21 +76,27 @@ int FAST_FUNC recursive_action(const char *fileName,
 	DIR *dir;
 	struct dirent *next;
 
-	if (!fileAction) fileAction = true_action;
-	if (!dirAction) dirAction = true_action;
-
 	follow = ACTION_FOLLOWLINKS;
 	if (depth == 0)
 		follow = ACTION_FOLLOWLINKS | ACTION_FOLLOWLINKS_L0;
 	follow &= flags;
-	status = (follow ? stat : lstat)(fileName, &statbuf);
+	if ((flags & ACTION_TYPE_ONLY)
+	 && d_type != DT_UNKNOWN
+	 && !(follow && d_type == DT_LNK)
+	) {
+		memset(&statbuf, 0, sizeof(statbuf));
+		statbuf.st_mode = DTTOIF(d_type);
+		status = 0;
+	} else {
+		status = fstatat(dir_fd, name, &statbuf, follow ? 0 : AT_SYMLINK_NOFOLLOW);
+	}
 	if (status < 0) {
 #ifdef DEBUG_RECURS_ACTION
 		bb_error_msg("status=%d flags=%x", status, flags);
 #endif
 		if ((flags & ACTION_DANGLING_OK)
 		 && errno == ENOENT
-		 && lstat(fileName, &statbuf) == 0
+		 && fstatat(dir_fd, name, &statbuf, AT_SYMLINK_NOFOLLOW) == 0
 		) {
 			/* Dangling link */
 			return fileAction(fileName, &statbuf, userData, depth);
@@ -111,7 +127,17 @@ int FAST_FUNC recursive_action(const char *fileName,
 			return TRUE;
 	}
 
-	dir = opendir(fileName);
+	if (flags & ACTION_OPENAT) {
+		int fd = openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_NOCTTY);
+		dir = NULL;
+		if (fd >= 0) {
+			dir = fdopendir(fd);
+			if (!dir)
+				close(fd);
+		}
+	} else {
+		dir = opendir(fileName);
+	}
 	if (!dir) {
 		/* findutils-4.1.20 reports this */
 		/* (i.e. it doesn't silently return with exit code 1) */
@@ -126,8 +152,11 @@ int FAST_FUNC recursive_action(const char *fileName,
 		if (nextFile == NULL)
 			continue;
 		/* process every file (NB: ACTION_RECURSE is set in flags) */
-		if (!recursive_action(nextFile, flags, fileAction, dirAction,
-						userData, depth + 1))
+		if (!recurse(nextFile,
+				(flags & ACTION_OPENAT) ? dirfd(dir) : AT_FDCWD,
+				(flags & ACTION_OPENAT) ? next->d_name : nextFile,
+				next->d_type,
+				flags, fileAction, dirAction, userData, depth + 1))
 			status = FALSE;
 //		s = recursive_action(nextFile, flags, fileAction, dirAction,
 //						userData, depth + 1);
@@ -154,3 +183,17 @@ int FAST_FUNC recursive_action(const char *fileName,
 		bb_simple_perror_msg(fileName);
 	return FALSE;
 }
+
+int FAST_FUNC recursive_action(const char *fileName,
+		unsigned flags,
+		int FAST_FUNC (*fileAction)(const char *fileName, struct stat *statbuf, void* userData, int depth),
+		int FAST_FUNC (*dirAction)(const char *fileName, struct stat *statbuf, void* userData, int depth),
+		void* userData,
+		unsigned depth)
+{
+	if (!fileAction) fileAction = true_action;
+	if (!dirAction) dirAction = true_action;
+
+	return recurse(fileName, AT_FDCWD, fileName, DT_UNKNOWN,
+			flags, fileAction, dirAction, userData, depth);
+}
@@ -32,6 +32,10 @@
 #define DEBUG_TIME 0
 #define DEBUG_PID 1
 #define DEBUG_SIG 1
+/* Count mallocs, print them per executed command on exit */
+#define DEBUG_ALLOC 0
+/* Count glob directory cache hits, print them on exit */
+#define DEBUG_GLOB 0
 
 #define PROFILE 0
 
@@ -107,6 +111,17 @@
 //config:	help
 //config:	  Enable job control in the ash shell.
 //config:
+//config:config ASH_JOBPOOL
+//config:	bool "Builtin 'jobpool' to run background jobs in a bounded pool"
+//config:	default y
+//config:	depends on ASH
+//config:	help
+//config:	  Enable "jobpool [-j N] CMD [ARG]..." builtin which starts CMD
+//config:	  in background, first waiting until fewer than N jobs
+//config:	  are running. Together with "wait -n" (which this option
+//config:	  enables even without ASH_BASH_COMPAT) it allows to run
+//config:	  a list of commands with bounded concurrency.
+//config:
 //config:config ASH_ALIAS
 //config:	bool "Alias support"
 //config:	default y
@@ -165,6 +180,15 @@
 //config:	help
 //config:	  Compile ash for reduced size at the price of speed.
 //config:
+//config:config ASH_GLOB_CACHE
+//config:	bool "Cache directory listings during globbing"
+//config:	default y
+//config:	depends on ASH
+//config:	help
+//config:	  While expanding words of one command, read each directory
+//config:	  only once: "cmd dir/*.c dir/*.h" reads dir once, not twice.
+//config:	  Also matches simple patterns like "*.c" without fnmatch().
+//config:
 //config:config ASH_RANDOM_SUPPORT
 //config:	bool "Pseudorandom generator and $RANDOM variable"
 //config:	default y
@@ -1332,6 +1356,23 @@ ckstrdup(const char *s)
 # define ckstrdup  xstrdup
 #endif
 
+#if DEBUG_ALLOC
+static unsigned alloc_cnt;      /* mallocs done */
+static unsigned alloc_reused;   /* stack blocks taken from the cache */
+static unsigned alloc_cmds;     /* commands executed */
+# undef ckrealloc
+# undef ckmalloc
+# undef ckzalloc
+# undef ckstrdup
+# define ckrealloc(p, n) (alloc_cnt++, xrealloc((p), (n)))
+# define ckmalloc(n)     (alloc_cnt++, xmalloc(n))
+# define ckzalloc(n)     (alloc_cnt++, xzalloc(n))
+# define ckstrdup(s)     (alloc_cnt++, xstrdup(s))
+# define ALLOC_STAT(cnt) ((cnt)++)
+#else
+# define ALLOC_STAT(cnt) ((void)0)
+#endif
+
 /*
  * It appears that grabstackstr() will barf with such alignments
  * because stalloc() will return a string allocated in a new stackblock.
@@ -1344,10 +1385,15 @@ enum {
 	SHELL_SIZE = sizeof(union { int i; char *cp; double d; }) - 1,
 	/* Minimum size of a block */
 	MINSIZE = SHELL_ALIGN(504),
+	/* Popped blocks up to this size are kept for reuse... */
+	STACK_CACHE_BLKSIZE = MINSIZE * 16,
+	/* ...but no more than this many of them */
+	STACK_CACHE_SIZE = 8,
 };
 
 struct stack_block {
 	struct stack_block *prev;
+	size_t size;            /* of space[], not valid for stackbase */
 	char space[MINSIZE];
 };
 
@@ -1366,6 +1412,8 @@ struct globals_memstack {
 	char *sstrend; // = stackbase.space + MINSIZE;
 	size_t g_stacknleft; // = MINSIZE;
 	int    herefd; // = -1;
+	struct stack_block *stackcache; /* free blocks, linked by ->prev */
+	unsigned stackcache_cnt;
 	struct stack_block stackbase;
 };
 extern struct globals_memstack *const ash_ptr_to_globals_memstack;
@@ -1377,6 +1425,8 @@ extern struct globals_memstack *const ash_ptr_to_globals_memstack;
 #define g_stacknleft (G_memstack.g_stacknleft)
 #define herefd       (G_memstack.herefd      )
 #define stackbase    (G_memstack.stackbase   )
+#define stackcache   (G_memstack.stackcache  )
+#define stackcache_cnt (G_memstack.stackcache_cnt)
 #define INIT_G_memstack() do { \
 	(*(struct globals_memstack**)&ash_ptr_to_globals_memstack) = xzalloc(sizeof(G_memstack)); \
 	barrier(); \
@@ -1391,6 +1441,43 @@ extern struct globals_memstack *const ash_ptr_to_globals_memstack;
 #define stackblock()     ((void *)g_stacknxt)
 #define stackblocksize() g_stacknleft
 
+/*
+ * Blocks freed by popstackmark() go to a small cache instead of free():
+ * every command pops its stack mark, and the next one would malloc
+ * the same blocks again. Block sizes are MINSIZE * 2^N, so that a block
+ * from the cache fits most requests. Called with interrupts off.
+ */
+static struct stack_block *
+stnewblock(size_t blocksize)
+{
+	struct stack_block **spp;
+	struct stack_block *sp;
+
+	for (spp = &stackcache; (sp = *spp) != NULL; spp = &sp->prev) {
+		if (sp->size >= blocksize) {
+			*spp = sp->prev;
+			stackcache_cnt--;
+			ALLOC_STAT(alloc_reused);
+			return sp;
+		}
+	}
+	sp = ckmalloc(sizeof(struct stack_block) - MINSIZE + blocksize);
+	sp->size = blocksize;
+	return sp;
+}
+
+static void
+stfreeblock(struct stack_block *sp)
+{
+	if (sp->size > STACK_CACHE_BLKSIZE || stackcache_cnt >= STACK_CACHE_SIZE) {
+		free(sp);
+		return;
+	}
+	sp->prev = stackcache;
+	stackcache = sp;
+	stackcache_cnt++;
+}
+
 /*
  * Parse trees for commands are allocated in lifo order, so we use a stack
  * to make this more efficient, and also to avoid all sorts of exception
@@ -1407,22 +1494,21 @@ stalloc(size_t nbytes)
 
 	aligned = SHELL_ALIGN(nbytes);
 	if (aligned > g_stacknleft) {
-		size_t len;
 		size_t blocksize;
 		struct stack_block *sp;
 
-		blocksize = aligned;
-		if (blocksize < MINSIZE)
-			blocksize = MINSIZE;
-		len = sizeof(struct stack_block) - MINSIZE + blocksize;
-		if (len < blocksize)
-			ash_msg_and_raise_error("%s", bb_msg_memory_exhausted);
+		blocksize = MINSIZE;
+		while (blocksize < aligned) {
+			blocksize *= 2;
+			if (blocksize > ((size_t)-1 >> 2))
+				ash_msg_and_raise_error("%s", bb_msg_memory_exhausted);
+		}
 		INT_OFF;
-		sp = ckmalloc(len);
+		sp = stnewblock(blocksize);
 		sp->prev = g_stackp;
 		g_stacknxt = sp->space;
-		g_stacknleft = blocksize;
-		sstrend = g_stacknxt + blocksize;
+		g_stacknleft = sp->size;
+		sstrend = g_stacknxt + sp->size;
 		g_stackp = sp;
 		INT_ON;
 	}
@@ -1484,7 +1570,7 @@ popstackmark(struct stackmark *mark)
 	while (g_stackp != mark->stackp) {
 		sp = g_stackp;
 		g_stackp = sp->prev;
-		free(sp);
+		stfreeblock(sp);
 	}
 	g_stacknxt = mark->stacknxt;
 	g_stacknleft = mark->stacknleft;
@@ -1526,6 +1612,7 @@ growstackblock(void)
 		grosslen = newlen + sizeof(struct stack_block) - MINSIZE;
 		sp = ckrealloc(sp, grosslen);
 		sp->prev = prevstackp;
+		sp->size = newlen;
 		g_stackp = sp;
 		g_stacknxt = sp->space;
 		g_stacknleft = newlen;
@@ -4192,20 +4279,85 @@ getstatus(struct job *job)
 	return retval;
 }
 
+/* "wait" argument: either a pid or a %jobspec */
+static struct job *
+getjob_or_pid(const char *name)
+{
+	struct job *job;
+	pid_t pid;
+
+	if (*name == '%')
+		return getjob(name, 0);
+	pid = number(name);
+	for (job = curjob; job; job = job->prev_job) {
+		if (job->ps[job->nprocs - 1].ps_pid == pid)
+			break;
+	}
+	return job;
+}
+
+#if ENABLE_ASH_BASH_COMPAT || ENABLE_ASH_JOBPOOL
+/* "wait -n [ID]...": wait until any of the given jobs (any job
+ * if none given) finishes, return its status. A job which has
+ * already finished but was not yet waited for counts too.
+ */
+static int
+wait_for_any_job(char **argv)
+{
+	for (;;) {
+		struct job *jp;
+		int running = 0;
+
+		for (jp = curjob; jp; jp = jp->prev_job) {
+			if (*argv) {
+				char **ap = argv;
+				while (*ap && getjob_or_pid(*ap) != jp)
+					ap++;
+				if (!*ap)
+					continue;
+			}
+			if (jp->state == JOBDONE && !jp->waited) {
+				jp->waited = 1;
+				return getstatus(jp);
+			}
+			if (jp->state == JOBRUNNING)
+				running = 1;
+		}
+		if (!running)
+			return 127;
+		blocking_wait_with_raise_on_sig();
+		if (pending_sig)
+			raise_exception(EXSIG);
+	}
+}
+#endif
+
 static int FAST_FUNC
 waitcmd(int argc UNUSED_PARAM, char **argv)
 {
 	struct job *job;
 	int retval;
 	struct job *jp;
+#if ENABLE_ASH_BASH_COMPAT || ENABLE_ASH_JOBPOOL
+	smallint wait_any = 0;
+#endif
 
 	if (pending_sig)
 		raise_exception(EXSIG);
 
+#if ENABLE_ASH_BASH_COMPAT || ENABLE_ASH_JOBPOOL
+	while (nextopt("n") != '\0')
+		wait_any = 1;
+#else
 	nextopt(nullstr);
+#endif
 	retval = 0;
 
 	argv = argptr;
+#if ENABLE_ASH_BASH_COMPAT || ENABLE_ASH_JOBPOOL
+	if (wait_any)
+		return wait_for_any_job(argv);
+#endif
 	if (!*argv) {
 		/* wait for all jobs */
 		for (;;) {
@@ -4238,19 +4390,9 @@ waitcmd(int argc UNUSED_PARAM, char **argv)
 
 	retval = 127;
 	do {
-		if (**argv != '%') {
-			pid_t pid = number(*argv);
-			job = curjob;
-			while (1) {
-				if (!job)
-					goto repeat;
-				if (job->ps[job->nprocs - 1].ps_pid == pid)
-					break;
-				job = job->prev_job;
-			}
-		} else {
-			job = getjob(*argv, 0);
-		}
+		job = getjob_or_pid(*argv);
+		if (!job)
+			goto repeat;
 		/* loop until process terminated or stopped */
 		while (job->state == JOBRUNNING)
 			blocking_wait_with_raise_on_sig();
@@ -5542,6 +5684,41 @@ static struct ifsregion *ifslastp;
 /* holds expanded arg list */
 static struct arglist exparg;
 
+#if ENABLE_ASH_GLOB_CACHE
+/*
+ * Directory listings read by expmeta() while expanding
+ * the words of one command (or "for" list).
+ */
+struct dircache {
+	struct dircache *next;
+	char *path;
+	char *names[1];         /* NULL terminated */
+};
+static struct dircache *dircache;
+static smallint dircache_on;
+# if DEBUG_GLOB
+static unsigned dircache_hits;
+static unsigned dircache_misses;
+#  define GLOB_STAT(cnt) ((cnt)++)
+# else
+#  define GLOB_STAT(cnt) ((void)0)
+# endif
+
+/* Drop cached listings, enable or disable caching */
+static void
+dircache_reset(int on)
+{
+	while (dircache) {
+		struct dircache *next = dircache->next;
+		free(dircache);
+		dircache = next;
+	}
+	dircache_on = on;
+}
+#else
+# define dircache_reset(on) ((void)0)
+#endif
+
 /*
  * Our own itoa().
  */
@@ -5840,6 +6017,8 @@ evalbackcmd(union node *n, struct backcmd *result)
 
 	saveherefd = herefd;
 	herefd = -1;
+	/* The command may create or remove files */
+	dircache_reset(dircache_on);
 
 	{
 		int pip[2];
@@ -6993,6 +7172,118 @@ addfname(const char *name)
 	exparg.lastp = &sp->next;
 }
 
+#if ENABLE_ASH_GLOB_CACHE
+/*
+ * Read the names in a directory. Returns NULL if it can't be opened.
+ * If caching is on, the result is remembered and must not be freed.
+ */
+static struct dircache *
+dircache_get(const char *path)
+{
+	struct dircache *dc;
+	DIR *dirp;
+	struct dirent *dp;
+	char *buf, *p;
+	size_t len, size;
+	unsigned cnt, i;
+
+	for (dc = dircache; dc; dc = dc->next) {
+		if (strcmp(dc->path, path) == 0) {
+			GLOB_STAT(dircache_hits);
+			return dc;
+		}
+	}
+	GLOB_STAT(dircache_misses);
+
+	dirp = opendir(path);
+	if (dirp == NULL)
+		return NULL;
+	buf = NULL;
+	len = size = 0;
+	cnt = 0;
+	while ((dp = readdir(dirp)) != NULL) {
+		size_t n = strlen(dp->d_name) + 1;
+		if (len + n > size) {
+			size = (len + n) * 2 + 256;
+			buf = ckrealloc(buf, size);
+		}
+		memcpy(buf + len, dp->d_name, n);
+		len += n;
+		cnt++;
+	}
+	closedir(dirp);
+
+	dc = ckmalloc(sizeof(*dc) + cnt * sizeof(dc->names[0]) + len + strlen(path) + 1);
+	p = (char*)&dc->names[cnt + 1];
+	memcpy(p, buf, len);
+	free(buf);
+	for (i = 0; i < cnt; i++) {
+		dc->names[i] = p;
+		p += strlen(p) + 1;
+	}
+	dc->names[cnt] = NULL;
+	dc->path = p;
+	strcpy(p, path);
+
+	if (dircache_on) {
+		dc->next = dircache;
+		dircache = dc;
+	}
+	return dc;
+}
+
+/*
+ * Glob pattern component, prepared for matching many names.
+ * "*", "PFX*", "*SFX" and "PFX*SFX" are matched without fnmatch().
+ */
+struct globmatch {
+	const char *pattern;
+	const char *sfx;
+	unsigned pfxlen;
+	unsigned sfxlen;
+	smallint simple;
+};
+
+static void
+globmatch_prepare(struct globmatch *gm, const char *pattern)
+{
+	const char *star = NULL;
+	const char *p;
+
+	gm->pattern = pattern;
+	gm->simple = 0;
+	for (p = pattern; *p; p++) {
+		if (*p == '*') {
+			if (star)
+				return;
+			star = p;
+		} else if (*p == '?' || *p == '[' || *p == '\\') {
+			return;
+		}
+	}
+	if (!star)
+		return;
+	gm->pfxlen = star - pattern;
+	gm->sfx = star + 1;
+	gm->sfxlen = p - gm->sfx;
+	gm->simple = 1;
+}
+
+static int
+globmatch(const struct globmatch *gm, const char *name)
+{
+	size_t len;
+
+	if (!gm->simple)
+		return pmatch(gm->pattern, name);
+	if (strncmp(name, gm->pattern, gm->pfxlen) != 0)
+		return 0;
+	len = strlen(name);
+	return len >= gm->pfxlen + gm->sfxlen
+		&& memcmp(name + len - gm->sfxlen, gm->sfx, gm->sfxlen) == 0;
+}
+#endif
+
 /*
  * Do metacharacter (i.e. *, ?, [...]) expansion.
  */
@@ -7005,8 +7296,14 @@ expmeta(char *expdir, char *enddir, char *name)
 	char *endname;
 	int metaflag;
 	struct stat statb;
+#if ENABLE_ASH_GLOB_CACHE
+	struct dircache *dc;
+	char **namep;
+	struct globmatch gm;
+#else
 	DIR *dirp;
 	struct dirent *dp;
+#endif
 	int atend;
 	int matchdot;
 
@@ -7068,9 +7365,15 @@ expmeta(char *expdir, char *enddir, char *name)
 		cp = expdir;
 		enddir[-1] = '\0';
 	}
+#if ENABLE_ASH_GLOB_CACHE
+	dc = dircache_get(cp);
+	if (dc == NULL)
+		return;
+#else
 	dirp = opendir(cp);
 	if (dirp == NULL)
 		return;
+#endif
 	if (enddir != expdir)
 		enddir[-1] = '/';
 	if (*endname == 0) {
@@ -7085,22 +7388,39 @@ expmeta(char *expdir, char *enddir, char *name)
 		p++;
 	if (*p == '.')
 		matchdot++;
+#if ENABLE_ASH_GLOB_CACHE
+	globmatch_prepare(&gm, start);
+	for (namep = dc->names; !pending_int && *namep; namep++) {
+		const char *d_name = *namep;
+#else
 	while (!pending_int && (dp = readdir(dirp)) != NULL) {
-		if (dp->d_name[0] == '.' && !matchdot)
+		const char *d_name = dp->d_name;
+#endif
+		if (d_name[0] == '.' && !matchdot)
 			continue;
-		if (pmatch(start, dp->d_name)) {
+#if ENABLE_ASH_GLOB_CACHE
+		if (globmatch(&gm, d_name))
+#else
+		if (pmatch(start, d_name))
+#endif
+		{
 			if (atend) {
-				strcpy(enddir, dp->d_name);
+				strcpy(enddir, d_name);
 				addfname(expdir);
 			} else {
-				for (p = enddir, cp = dp->d_name; (*p++ = *cp++) != '\0';)
+				for (p = enddir, cp = d_name; (*p++ = *cp++) != '\0';)
 					continue;
 				p[-1] = '/';
 				expmeta(expdir, p, endname);
 			}
 		}
 	}
+#if ENABLE_ASH_GLOB_CACHE
+	if (!dircache_on)
+		free(dc);
+#else
 	closedir(dirp);
+#endif
 	if (!atend)
 		endname[-1] = '/';
 }
@@ -7511,6 +7831,162 @@ shellexec(char **argv, const char *path, int idx)
 	/* NOTREACHED */
 }
 
+#if ENABLE_FEATURE_SH_VFORK
+/*
+ * Fast path for evalcommand: start a simple external command with vfork().
+ * Redirections are already done by the caller, so the child only has
+ * to fix up signals, drop saved fds and exec. Everything which needs
+ * memory (argv for the ENOEXEC case, environment with VAR=VAL
+ * assignments merged in, full pathname) is prepared here, in the parent,
+ * on the stack of the current command.
+ *
+ * Returns pid of the child, or 0 if the command has to go through
+ * forkshell() + shellexec() (applets, readonly assignments, ...).
+ *
+ * Called with interrupts off.
+ */
+static int
+vforkexec(struct job *jp, union node *n, char **argv, const char *path,
+		int idx, struct strlist *vars)
+{
+	char **envp, **ep, **new, **cmds;
+	char *cmd;
+	const struct strlist *sp;
+	struct redirtab *rp;
+	sigset_t allsigs, oldset;
+	int cnt, i, e, pid;
+	/* Set by the child if it fails to exec: the child
+	 * must not allocate, so the parent reports the error */
+	volatile int exec_errno = 0;
+
+#if ENABLE_FEATURE_SH_STANDALONE
+	/* NOEXEC applets run in the child without exec */
+	if (find_applet_by_name(argv[0]) >= 0)
+		return 0;
+#endif
+	cmd = argv[0];
+	if (!strchr(cmd, '/')) {
+		/* Same candidates as in shellexec, in the same order:
+		 * if the hashed one went away, the next one is run */
+		const char *p = path;
+
+		if (idx < 0)
+			return 0;
+		cnt = 0;
+		i = idx;
+		while ((cmd = path_advance(&p, argv[0])) != NULL) {
+			if (--i < 0 && pathopt == NULL)
+				cnt++;
+			stunalloc(cmd);
+		}
+		if (!cnt)
+			return 0;
+		cmds = stalloc((cnt + 1) * sizeof(cmds[0]));
+		cnt = 0;
+		while ((cmd = path_advance(&path, argv[0])) != NULL) {
+			if (--idx < 0 && pathopt == NULL)
+				cmds[cnt++] = cmd;
+			else
+				stunalloc(cmd);
+		}
+	} else {
+		cmds = stalloc(2 * sizeof(cmds[0]));
+		cmds[0] = cmd;
+		cnt = 1;
+	}
+	cmds[cnt] = NULL;
+
+	/* "VAR=VAL cmd": merge assignments into exported vars */
+	cnt = 0;
+	for (sp = vars; sp; sp = sp->next) {
+		struct var *vp = *findvar(hashvar(sp->text), sp->text);
+		if (vp && (vp->flags & VREADONLY))
+			return 0; /* let the child complain */
+		cnt++;
+	}
+	envp = listvars(VEXPORT, VUNSET, &ep);
+	if (cnt) {
+		new = stalloc((ep - envp + cnt + 1) * sizeof(new[0]));
+		memcpy(new, envp, (ep - envp) * sizeof(new[0]));
+		ep = new + (ep - envp);
+		envp = new;
+		for (sp = vars; sp; sp = sp->next) {
+			for (new = envp; new < ep; new++) {
+				if (varcmp(*new, sp->text) == 0)
+					break;
+			}
+			*new = sp->text;
+			if (new == ep)
+				ep++;
+		}
+		*ep = NULL;
+	}
+
+	/* argv for running cmd as a shell script, see tryexec */
+	for (cnt = 0; argv[cnt]; cnt++)
+		continue;
+	new = stalloc((cnt + 2) * sizeof(new[0]));
+	new[0] = (char*) "ash";
+	memcpy(new + 2, argv + 1, cnt * sizeof(new[0]));
+
+	/* No signal handlers must run in the child while it shares
+	 * our memory: block everything until it resets them */
+	sigfillset(&allsigs);
+	sigprocmask(SIG_SETMASK, &allsigs, &oldset);
+	pid = vfork();
+	if (pid == 0) {
+		/* Child. Do not touch shell state, do not allocate */
+		struct sigaction act;
+
+		memset(&act, 0, sizeof(act));
+		act.sa_handler = SIG_DFL;
+		for (i = 1; i < NSIG; i++) {
+			/* Caught sigs would be reset by exec, but only after
+			 * we unblock them. Ignored ones: see forkchild */
+			if (sigmode[i - 1] == S_CATCH
+			 || (sigmode[i - 1] == S_IGN && rootshell
+			    && (i == SIGQUIT || (iflag && (i == SIGINT || i == SIGTERM))))
+			) {
+				sigaction(i, &act, NULL);
+			}
+		}
+		sigprocmask(SIG_SETMASK, &oldset, NULL);
+		/* Same as clearredir(1), without freeing anything */
+		for (rp = redirlist; rp; rp = rp->next) {
+			for (i = 0; i < rp->pair_count; i++) {
+				int copy = rp->two_fd[i].copy;
+				if (copy != CLOSED && copy != EMPTY)
+					close(copy & ~COPYFD_RESTORE);
+			}
+		}
+		e = ENOENT;
+		for (i = 0; cmds[i]; i++) {
+			execve(cmds[i], argv, envp);
+			if (errno == ENOEXEC) {
+				new[1] = cmds[i];
+				execve(bb_busybox_exec_path, new, envp);
+			}
+			/* As in shellexec: "dir/cmd" reports any error */
+			if ((errno != ENOENT && errno != ENOTDIR) || cmds[i] == argv[0])
+				e = errno;
+		}
+		exec_errno = e;
+		_exit(e == EACCES ? 126 : e == ENOENT ? 127 : 2);
+	}
+	sigprocmask(SIG_SETMASK, &oldset, NULL);
+	if (pid < 0) {
+		TRACE(("Vfork failed, errno=%d", errno));
+		freejob(jp);
+		ash_msg_and_raise_error("can't fork");
+	}
+	/* vfork() returns after the child has exec'ed or exited */
+	if (exec_errno)
+		ash_msg("%s: %s", argv[0], errmsg(exec_errno, "not found"));
+	forkparent(jp, n, FORK_FG, pid);
+	return pid;
+}
+#endif
+
 static void
 printentry(struct tblentry *cmdp)
 {
@@ -8542,12 +9018,16 @@ evalfor(union node *n, int flags)
 	setstackmark(&smark);
 	arglist.list = NULL;
 	arglist.lastp = &arglist.list;
+	dircache_reset(1);
 	for (argp = n->nfor.args; argp; argp = argp->narg.next) {
 		expandarg(argp, &arglist, EXP_FULL | EXP_TILDE | EXP_RECORD);
 		/* XXX */
 		if (evalskip)
-			goto out;
+			break;
 	}
+	dircache_reset(0);
+	if (evalskip)
+		goto out;
 	*arglist.lastp = NULL;
 
 	exitstatus = 0;
@@ -9007,6 +9487,80 @@ execcmd(int argc UNUSED_PARAM, char **argv)
 	return 0;
 }
 
+#if ENABLE_ASH_JOBPOOL
+/*
+ * The jobpool command: "jobpool [-j N] CMD [ARG]..."
+ * Runs CMD in background as "CMD ARG... &" would, but first waits
+ * until fewer than N (default: number of CPUs) jobs are running.
+ * While the pool is full we sleep in waitpid() - no polling.
+ * Exit statuses are collected with "wait" or "wait -n".
+ */
+static int FAST_FUNC
+jobpoolcmd(int argc, char **argv)
+{
+	struct cmdentry entry;
+	struct job *jp;
+	unsigned max_jobs;
+
+	max_jobs = 0;
+	if (nextopt("j:"))
+		max_jobs = number(optionarg);
+	argv = argptr;
+	if (!*argv)
+		ash_msg_and_raise_error("usage: jobpool [-j N] command [arg]...");
+	if (max_jobs == 0) {
+		max_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+		if ((int)max_jobs <= 0)
+			max_jobs = 1;
+	}
+	argc = 0;
+	while (argv[argc])
+		argc++;
+
+	for (;;) {
+		unsigned running = 0;
+
+		for (jp = curjob; jp; jp = jp->prev_job) {
+			if (jp->state == JOBRUNNING)
+				running++;
+		}
+		if (running < max_jobs)
+			break;
+		blocking_wait_with_raise_on_sig();
+		if (pending_sig)
+			raise_exception(EXSIG);
+	}
+
+	/* Look it up in the parent: PATH search result gets hashed */
+	find_command(argv[0], &entry, DO_ERR, pathval());
+	if (entry.cmdtype == CMDUNKNOWN) {
+		flush_stdout_stderr();
+		return 127;
+	}
+
+	INT_OFF;
+	jp = makejob(/*n,*/ 1);
+	if (forkshell(jp, NULL, FORK_BG) == 0) {
+		/* child */
+		INT_ON;
+		switch (entry.cmdtype) {
+		default: /* CMDNORMAL */
+			shellexec(argv, pathval(), entry.u.index);
+			/* NOTREACHED */
+		case CMDBUILTIN:
+			evalbltin(entry.u.cmd, argc, argv);
+			break;
+		case CMDFUNCTION:
+			evalfun(entry.u.func, argc, argv, 0);
+			break;
+		}
+		exitshell();
+	}
+	INT_ON;
+	return 0;
+}
+#endif
+
 /*
  * The return command.
  */
@@ -9112,6 +9666,9 @@ static const struct builtincmd builtintab[] = {
 #if MAX_HISTORY
 	{ BUILTIN_NOSPEC        "history" , historycmd },
 #endif
+#if ENABLE_ASH_JOBPOOL
+	{ BUILTIN_REGULAR       "jobpool" , jobpoolcmd },
+#endif
 #if JOBS
 	{ BUILTIN_REGULAR       "jobs"    , jobscmd    },
 	{ BUILTIN_REGULAR       "kill"    , killcmd    },
@@ -9227,6 +9784,7 @@ evalcommand(union node *cmd, int flags)
 
 	/* First expand the arguments. */
 	TRACE(("evalcommand(0x%lx, %d) called\n", (long)cmd, flags));
+	ALLOC_STAT(alloc_cmds);
 	setstackmark(&smark);
 	back_exitstatus = 0;
 
@@ -9243,6 +9801,7 @@ evalcommand(union node *cmd, int flags)
 		pseudovarflag = bcmd && IS_BUILTIN_ASSIGN(bcmd);
 	}
 
+	dircache_reset(1);
 	for (argp = cmd->ncmd.args; argp; argp = argp->narg.next) {
 		struct strlist **spp;
 
@@ -9255,6 +9814,7 @@ evalcommand(union node *cmd, int flags)
 		for (sp = *spp; sp; sp = sp->next)
 			argc++;
 	}
+	dircache_reset(0);
 
 	argv = nargv = stalloc(sizeof(char *) * (argc + 1));
 	for (sp = arglist.list; sp; sp = sp->next) {
@@ -9382,6 +9942,18 @@ evalcommand(union node *cmd, int flags)
 			/* No, forking off a child is necessary */
 			INT_OFF;
 			jp = makejob(/*cmd,*/ 1);
+#if ENABLE_FEATURE_SH_VFORK
+			/* Nothing to do in the child but exec?
+			 * Then don't copy our address space for it */
+			if (!doing_jobctl && !may_have_traps
+			 && vforkexec(jp, cmd, argv, path, cmdentry.u.index, varlist.list) != 0
+			) {
+				exitstatus = waitforjob(jp);
+				INT_ON;
+				TRACE(("vforked child exited with %d\n", exitstatus));
+				break;
+			}
+#endif
 			if (forkshell(jp, cmd, FORK_FG) != 0) {
 				/* parent */
 				exitstatus = waitforjob(jp);
@@ -9426,6 +9998,9 @@ evalcommand(union node *cmd, int flags)
 			if (i == EXSIG)
 				exit_status = 128 + pending_sig;
 			exitstatus = exit_status;
+			/* Error in "command eval ..." may have skipped
+			 * dircache_reset(0), see reset() */
+			dircache_reset(0);
 			if (i == EXINT || spclbltin > 0) {
  raise:
 				longjmp(exception_handler->loc, 1);
@@ -12980,6 +13555,20 @@ exitshell(void)
 	flush_stdout_stderr();
  out:
 	setjobctl(0);
+#if DEBUG_ALLOC
+	if (rootshell) {
+		unsigned per100 = alloc_cmds ? alloc_cnt * 100ULL / alloc_cmds : 0;
+		fdprintf(2, "%s: %u commands, %u mallocs (%u.%02u per command),"
+			" %u stack blocks reused\n",
+			arg0, alloc_cmds, alloc_cnt, per100 / 100, per100 % 100,
+			alloc_reused);
+	}
+#endif
+#if ENABLE_ASH_GLOB_CACHE && DEBUG_GLOB
+	if (rootshell)
+		fdprintf(2, "%s: glob directory cache: %u hits, %u misses\n",
+			arg0, dircache_hits, dircache_misses);
+#endif
 	_exit(status);
 	/* NOTREACHED */
 }
@@ -13132,6 +13721,10 @@ reset(void)
 	/* from eval.c: */
 	evalskip = 0;
 	loopnest = 0;
+	/* from expand.c: */
+	/* An error in expandarg() skips the dircache_reset(0)
+	 * in evalcommand()/evalfor(): don't glob with stale listings */
+	dircache_reset(0);
 	/* from input.c: */
 	g_parsefile->left_in_buffer = 0;
 	g_parsefile->left_in_line = 0;      /* clear input buffer */
@@ -275,6 +275,8 @@
 
 /* Build knobs */
 #define LEAK_HUNTING 0
+/* Count mallocs, print them per executed command on exit */
+#define ALLOC_STATS 0
 #define BUILD_AS_NOMMU 0
 /* Enable/disable sanity checks. Ok to enable in production,
  * only adds a bit of bloat. Set to >1 to get non-production level verbosity.
@@ -1077,6 +1079,31 @@ static void xxfree(void *ptr)
 # define free(p)        xxfree(p)
 #endif
 
+/* Allocation stats. Shows how much malloc work a command costs.
+ */
+#if ALLOC_STATS
+static unsigned alloc_cnt;      /* mallocs done */
+static unsigned alloc_cmds;     /* pipes executed */
+# define xmalloc(s)     (alloc_cnt++, xmalloc(s))
+# define xzalloc(s)     (alloc_cnt++, xzalloc(s))
+# define xrealloc(p, s) (alloc_cnt++, xrealloc((p), (s)))
+# define xstrdup(s)     (alloc_cnt++, xstrdup(s))
+# define ALLOC_STAT(cnt) ((cnt)++)
+static void print_alloc_stats(void)
+{
+	unsigned per100;
+
+	if (getpid() != G.root_pid)
+		return;
+	per100 = alloc_cmds ? alloc_cnt * 100ULL / alloc_cmds : 0;
+	fdprintf(2, "hush: %u commands, %u mallocs (%u.%02u per command)\n",
+		alloc_cmds, alloc_cnt, per100 / 100, per100 % 100);
+}
+#else
+# define ALLOC_STAT(cnt) ((void)0)
+# define print_alloc_stats() ((void)0)
+#endif
+
 
 /* Syntax and runtime errors. They always abort scripts.
  * In interactive use they usually discard unparsed and/or unexecuted commands
@@ -1561,6 +1588,8 @@ static void hush_exit(int exitcode)
 		builtin_eval(argv);
 	}
 
+	print_alloc_stats();
+
 #if ENABLE_FEATURE_CLEAN_UP
 	{
 		struct variable *cur_var;
@@ -2187,7 +2216,10 @@ static ALWAYS_INLINE void o_free_unsafe(o_string *o)
 static void o_grow_by(o_string *o, int len)
 {
 	if (o->length + len > o->maxlen) {
-		o->maxlen += (2*len > B_CHUNK ? 2*len : B_CHUNK);
+		/* Grow geometrically: long expansions would do
+		 * a realloc per B_CHUNK otherwise */
+		int grow = o->maxlen > B_CHUNK ? o->maxlen : B_CHUNK;
+		o->maxlen += (2*len > grow ? 2*len : grow);
 		o->data = xrealloc(o->data, 1 + o->maxlen);
 	}
 }
@@ -6387,6 +6419,86 @@ static void execvp_or_die(char **argv)
 	_exit(127); /* bash compat */
 }
 
+#if ENABLE_FEATURE_SH_VFORK
+/* Fast path for a lone foreground external command.
+ * Redirects and assignments are set up in the parent (as for builtins)
+ * and undone after the child is started, so the child only needs to exec.
+ * Then there is no need to copy our address space: vfork() is enough.
+ */
+#if !ENABLE_FEATURE_SH_STANDALONE
+#define vfork_exec_is_ok(command, argv) \
+	vfork_exec_is_ok(command)
+#endif
+static int vfork_exec_is_ok(struct command *command, char **argv)
+{
+	struct redir_struct *redir;
+
+	if (G.traps || (G.special_sig_mask & SPECIAL_JOBSTOP_SIGS))
+		return 0;
+#if ENABLE_HUSH_JOB
+	if (G.run_list_level == 1 && G_interactive_fd)
+		return 0; /* child has to set its pgrp */
+#endif
+	/* restore_redirects() handles only fds 0,1,2 */
+	for (redir = command->redirects; redir; redir = redir->next) {
+		if (redir->rd_fd > 2)
+			return 0;
+	}
+#if ENABLE_FEATURE_SH_STANDALONE
+	/* NOEXEC applets are run in the child without exec */
+	if (!strchr(argv[0], '/') && find_applet_by_name(argv[0]) >= 0)
+		return 0;
+#endif
+	return 1;
+}
+
+static pid_t vfork_exec(char **argv, int squirrel[3])
+{
+	sigset_t allsigs, oldset;
+	pid_t pid;
+	/* The child must not allocate (bb_perror_msg does),
+	 * it leaves errno here for us to report */
+	volatile int exec_errno = 0;
+
+	/* Our handlers must not run in the child while it shares
+	 * our memory: block all signals until it resets them */
+	sigfillset(&allsigs);
+	sigprocmask(SIG_SETMASK, &allsigs, &oldset);
+	pid = vfork();
+	if (pid == 0) { /* child */
+		struct sigaction sa;
+		unsigned mask;
+		int sig;
+
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler = SIG_DFL;
+		mask = G.special_sig_mask | G_fatal_sig_mask;
+		sig = 0;
+		while ((mask >>= 1) != 0) {
+			sig++;
+			if (mask & 1)
+				sigaction(sig, &sa, NULL);
+		}
+		sigprocmask(SIG_SETMASK, &oldset, NULL);
+		for (sig = 0; sig < 3; sig++) {
+			if (squirrel[sig] >= 0)
+				close(squirrel[sig]);
+		}
+		debug_printf_exec("vfork-execing '%s'\n", argv[0]);
+		execvp(argv[0], argv);
+		exec_errno = errno;
+		_exit(127); /* bash compat */
+	}
+	sigprocmask(SIG_SETMASK, &oldset, NULL);
+	/* vfork() returns after the child has exec'ed or exited */
+	if (exec_errno) {
+		errno = exec_errno;
+		bb_perror_msg("can't execute '%s'", argv[0]);
+	}
+	return pid;
+}
+#endif
+
 #if ENABLE_HUSH_MODE_X
 static void dump_cmd_in_x_mode(char **argv)
 {
@@ -6922,6 +7034,7 @@ static NOINLINE int run_pipe(struct pipe *pi)
 
 	debug_printf_exec("run_pipe start: members:%d\n", pi->num_cmds);
 	debug_enter();
+	ALLOC_STAT(alloc_cmds);
 
 	/* Testcase: set -- q w e; (IFS='' echo "$*"; IFS=''; echo "$*"); echo "$*"
 	 * Result should be 3 lines: q w e, qwe, q w e
@@ -7135,6 +7248,35 @@ static NOINLINE int run_pipe(struct pipe *pi)
 				goto clean_up_and_ret;
 			}
 		}
+#if ENABLE_FEATURE_SH_VFORK
+		if (vfork_exec_is_ok(command, argv_expanded)) {
+			rcode = redirect_and_varexp_helper(&new_env, &old_vars, command, squirrel, argv_expanded);
+			if (rcode == 0) {
+				command->pid = vfork_exec(argv_expanded, squirrel);
+				if (command->pid < 0) {
+					bb_perror_msg("vfork");
+					rcode = 1;
+				} else {
+# if ENABLE_HUSH_FAST
+					G.count_SIGCHLD++;
+# endif
+					/* pi->alive_cmds is already 1 */
+					rcode = -1;
+				}
+			}
+			/* Child has its own copy of env and fds, restore ours */
+			unset_vars(new_env);
+			add_vars(old_vars);
+			restore_redirects(squirrel);
+			free(argv_expanded);
+			if (rcode >= 0) {
+				IF_HAS_KEYWORDS(if (pi->pi_inverted) rcode = !rcode;)
+			}
+			debug_leave();
+			debug_printf_exec("run_pipe return %d\n", rcode);
+			return rcode;
+		}
+#endif
 		/* It is neither builtin nor applet. We must fork. */
 	}
 
@@ -250,6 +250,75 @@ typedef struct remembered_name {
 	const char *var;
 } remembered_name;
 
+#if ENABLE_SH_MATH_CACHE
+/* Compiled form of an expression.
+ * Which operators get applied, and in which order, depends only on
+ * the text of the expression, not on the values. Thus we can record
+ * the sequence of pushes and applies made by the parser and replay it
+ * later without tokenizing the text again.
+ */
+typedef struct arith_insn {
+	operator op;      /* TOK_NUM: push var/val; else: apply op */
+	const char *var;  /* for TOK_NUM: variable name or NULL */
+	arith_t val;      /* for TOK_NUM without var: the number */
+} arith_insn;
+
+typedef struct arith_prog {
+	unsigned expr_len;
+	unsigned ninsn;
+	char *expr;
+	arith_insn insn[1];
+} arith_prog;
+
+/* Cached expressions are longer than this rarely, if ever */
+#define ARITH_CACHE_MAXLEN 256
+/* Direct-mapped cache, must be a power of 2 */
+#define ARITH_CACHE_SIZE   32
+
+static arith_prog *arith_cache[ARITH_CACHE_SIZE];
+
+static unsigned
+arith_hash(const char *expr)
+{
+	unsigned h = 0;
+	while (*expr)
+		h = h * 31 + (unsigned char)*expr++;
+	return h & (ARITH_CACHE_SIZE - 1);
+}
+
+static void
+arith_cache_save(const char *expr, unsigned expr_len, arith_insn *insn, unsigned ninsn)
+{
+	arith_prog *prog;
+	unsigned i, size;
+	char *p;
+
+	/* Space for expr and for all var names */
+	size = expr_len;
+	for (i = 0; i < ninsn; i++) {
+		if (insn[i].op == TOK_NUM && insn[i].var)
+			size += strlen(insn[i].var) + 1;
+	}
+	prog = xmalloc(sizeof(*prog) + ninsn * sizeof(insn[0]) + size);
+	prog->expr_len = expr_len;
+	prog->ninsn = ninsn;
+	memcpy(prog->insn, insn, ninsn * sizeof(insn[0]));
+	p = (char*)&prog->insn[ninsn + 1];
+	prog->expr = p;
+	p = stpcpy(p, expr) + 1;
+	for (i = 0; i < ninsn; i++) {
+		if (prog->insn[i].op == TOK_NUM && prog->insn[i].var) {
+			prog->insn[i].var = p;
+			p = stpcpy(p, insn[i].var) + 1;
+		}
+	}
+
+	i = arith_hash(expr);
+	free(arith_cache[i]);
+	arith_cache[i] = prog;
+}
+#endif
+
 
 static arith_t FAST_FUNC
 evaluate_string(arith_state_t *math_state, const char *expr);
@@ -273,6 +342,17 @@ arith_lookup_val(arith_state_t *math_state, var_or_num_t *t)
 				}
 			}
 
+			/* Fast path: var holds a plain number.
+			 * No need to parse it as an expression.
+			 */
+			if (isdigit(*p)) {
+				char *end;
+				errno = 0;
+				t->val = strto_arith_t(p, &end, 0);
+				if (*end == '\0' && errno == 0)
+					return 0;
+			}
+
 			/* push current var name */
 			cur = math_state->list_of_recursed_names;
 			cur_save.var = t->var;
@@ -494,6 +574,40 @@ static const char op_tokens[] ALIGN1 = {
 };
 #define ptr_to_rparen (&op_tokens[sizeof(op_tokens)-7])
 
+#if ENABLE_SH_MATH_CACHE
+static arith_t
+evaluate_prog(arith_state_t *math_state, const arith_prog *prog)
+{
+	var_or_num_t *const numstack = alloca((prog->expr_len / 2) * sizeof(numstack[0]));
+	var_or_num_t *numstackptr = numstack;
+	const arith_insn *insn = prog->insn;
+	const arith_insn *end = insn + prog->ninsn;
+	const char *errmsg = NULL;
+
+	for (; insn < end; insn++) {
+		if (insn->op == TOK_NUM) {
+			numstackptr->var = (char*)insn->var;
+			numstackptr->val = insn->val;
+			numstackptr->second_val_present = 0;
+			numstackptr++;
+			continue;
+		}
+		errmsg = arith_apply(math_state, insn->op, numstack, &numstackptr);
+		if (errmsg) {
+			numstack->val = -1;
+			goto ret;
+		}
+	}
+	if (numstack->var) {
+		/* expression is $((var)) only, lookup now */
+		errmsg = arith_lookup_val(math_state, numstack);
+	}
+ ret:
+	math_state->errmsg = errmsg;
+	return numstack->val;
+}
+#endif
+
 static arith_t FAST_FUNC
 evaluate_string(arith_state_t *math_state, const char *expr)
 {
@@ -510,6 +624,30 @@ evaluate_string(arith_state_t *math_state, const char *expr)
 	/* Stack of operator tokens */
 	operator *const stack = alloca(expr_len * sizeof(stack[0]));
 	operator *stackptr = stack;
+#if ENABLE_SH_MATH_CACHE
+	/* Recorded pushes and applies. There are at most as many
+	 * pushes and as many applies as there are chars in expr */
+	arith_insn *insn_start = NULL;
+	arith_insn *insn = NULL;
+
+	if (*expr) {
+		arith_prog *prog = arith_cache[arith_hash(expr)];
+		if (prog && strcmp(prog->expr, expr) == 0)
+			return evaluate_prog(math_state, prog);
+		if (expr_len <= ARITH_CACHE_MAXLEN)
+			insn_start = insn = alloca(expr_len * 2 * sizeof(insn[0]));
+	}
+# define RECORD_INSN(o, v, n) do { \
+	if (insn) { \
+		insn->op = (o); \
+		insn->var = (v); \
+		insn->val = (n); \
+		insn++; \
+	} \
+} while (0)
+#else
+# define RECORD_INSN(o, v, n) ((void)0)
+#endif
 
 	/* Start with a left paren */
 	*stackptr++ = lasttok = TOK_LPAREN;
@@ -551,6 +689,13 @@ evaluate_string(arith_state_t *math_state, const char *expr)
 				/* expression is $((var)) only, lookup now */
 				errmsg = arith_lookup_val(math_state, numstack);
 			}
+#if ENABLE_SH_MATH_CACHE
+			/* Successfully parsed. Do not replace cache entries
+			 * while evaluating a var's value: the entry being replaced
+			 * can be executing one recursion level up */
+			if (insn && !errmsg && !math_state->list_of_recursed_names)
+				arith_cache_save(start_expr, expr_len, insn_start, insn - insn_start);
+#endif
 			goto ret;
 		}
 
@@ -560,8 +705,10 @@ evaluate_string(arith_state_t *math_state, const char *expr)
 			size_t var_name_size = (p-expr) + 1;  /* +1 for NUL */
 			numstackptr->var = alloca(var_name_size);
 			safe_strncpy(numstackptr->var, expr, var_name_size);
+			numstackptr->val = 0;
 			expr = p;
  num:
+			RECORD_INSN(TOK_NUM, numstackptr->var, numstackptr->val);
 			numstackptr->second_val_present = 0;
 			numstackptr++;
 			lasttok = TOK_NUM;
@@ -675,6 +822,7 @@ evaluate_string(arith_state_t *math_state, const char *expr)
 						break;
 					}
 				}
+				RECORD_INSN(prev_op, NULL, 0);
 				errmsg = arith_apply(math_state, prev_op, numstack, &numstackptr);
 				if (errmsg)
 					goto err_with_custom_msg;
@@ -695,6 +843,7 @@ evaluate_string(arith_state_t *math_state, const char *expr)
  ret:
 	math_state->errmsg = errmsg;
 	return numstack->val;
+#undef RECORD_INSN
 }
 
 arith_t FAST_FUNC
@@ -0,0 +1,11 @@
+# Pure arithmetic on every record
+{
+	x = $10 * 3 + NR % 7
+	y = (x > 1000) ? x / 2 : x * 2
+	acc += (y - int(y / 3) * 3) * ($NF < 0.5 ? -1 : 1)
+	if (NR % 2 == 0 && $9 != 404 || x < 10)
+		odd++
+}
+END {
+	printf "%.2f %d\n", acc, odd
+}
@@ -0,0 +1,13 @@
+# Average and maximum latency per method and hour
+{
+	split($4, t, ":")
+	k = substr($6, 2) " " t[2]
+	cnt[k]++
+	sum[k] += $NF
+	if ($NF > max[k])
+		max[k] = $NF
+}
+END {
+	for (k in cnt)
+		printf "%s %d %.4f %.3f\n", k, cnt[k], sum[k] / cnt[k], max[k]
+}
@@ -0,0 +1,20 @@
+# Requests, bytes and errors per status and per client
+{
+	n++
+	bytes += $10
+	status[$9]++
+	client[$1] += $10
+	if ($9 >= 400)
+		errors++
+}
+END {
+	print n, bytes, errors
+	for (s in status)
+		print "status", s, status[s]
+	for (c in client)
+		if (client[c] > max) {
+			max = client[c]
+			top = c
+		}
+	print "top", top, max
+}
@@ -0,0 +1,16 @@
+# String handling: normalize URLs, count the distinct ones
+{
+	url = $7
+	q = index(url, "?")
+	if (q)
+		url = substr(url, 1, q - 1)
+	url = tolower(url) "/" ($9 == 200 ? "ok" : "fail")
+	if (!(url in seen)) {
+		seen[url] = 1
+		distinct++
+	}
+	len += length(url)
+}
+END {
+	print distinct, len
+}